@@ -1,102 +1,186 @@
 #version 430
 in vec3 linspace;
-uniform vec3 eye;
-uniform float stepSize;
+//0: front face positions, 1: raymarching, 2: raymarching into the reduced
+//resolution target, 3: upsampling the reduced resolution target, 4: resolving
+//the marched subset with the reprojected history
 uniform int backside;
 uniform sampler2D frontside_tex;
-uniform sampler2D noise2D;
-uniform float time;
-out vec4 color;
+//computes the front faces analytically instead of reading frontside_tex
+uniform int singlePass;
+uniform sampler2D lowres_tex;
+uniform float resolutionDivisor;
+//every subsetStride-th pixel in both directions, starting at subsetOffset,
+//is marched this frame
+uniform int subsetStride;
+uniform ivec2 subsetOffset;
+uniform sampler2D subset_tex;
+uniform sampler2D subset_depth_tex;
+uniform sampler2D history_tex;
+uniform int historyValid;
+uniform mat4 prevmat;
+layout(location = 0) out vec4 color;
+//opacity weighted distance of the clouds from the ray start, used to
+//reproject the marched subset of the temporal accumulation
+layout(location = 1) out float cloud_depth;
 
-const vec3 sun_dir = normalize(vec3(0, 1, 0));
-const vec3 domain_border_min = vec3(-1, -1, -1);
-const vec3 domain_border_max = vec3(1,1,2);
-float noise(in vec2 x){
-  return texture(noise2D, x).r;
+#include "shader/frame.glsl"
+#include "shader/density.glsl"
+#include "shader/lighting.glsl"
+#include "shader/raymarch.glsl"
+//direction of the ray from the eye through pixel (in full resolution window
+//coordinates), not normalized
+vec3 pixelRay(vec2 pixel){
+  vec4 far_pos = inv_cammat * vec4(pixel / viewport * 2.0 - 1.0, 1.0, 1.0);
+  return far_pos.xyz / far_pos.w - eye;
 }
-float onBorder(vec3 pos){
-  const float border_size = 0.002 * length(eye - pos);
-  int num_near_zero = 0;
-  float att[3];
-  int index = 0;
-  for(int i = 0; i < 3; i++){
-    if(pos[i] <= domain_border_min[i] + border_size){
-      att[num_near_zero++] = 1.0 - ((pos[i] - domain_border_min[i]) / border_size);
-    }
-    if(pos[i] >= domain_border_max[i]-border_size){
-      att[num_near_zero++] = (pos[i] - (domain_border_max[i] - border_size)) / border_size;
-    }
+//front face position of the box seen through pixel (in full resolution
+//window coordinates), the alpha is 0 if the pixel does not see a front face.
+//frontside_tex holds the positions, or with FRONTSIDE_BOX the positions
+//normalized to the box, or with FRONTSIDE_DEPTH their distance from the eye
+//(0 for no front face).
+vec4 frontside(vec2 pixel){
+  if(singlePass == 0){
+    ivec2 texel = min(ivec2(pixel), ivec2(viewport) - 1);
+    vec4 stored = texelFetch(frontside_tex, texel, 0);
+#if defined(FRONTSIDE_DEPTH)
+    if(stored.r == 0.0) return vec4(0);
+    return vec4(eye + stored.r * normalize(pixelRay(vec2(texel) + 0.5)), 1.0);
+#elif defined(FRONTSIDE_BOX)
+    return vec4(mix(domain_border_min, domain_border_max, stored.rgb), stored.a);
+#else
+    return stored;
+#endif
   }
-  float a = 1.0;
-  if(num_near_zero > 1){
-   for(int i = 0; i < num_near_zero; i++){
-     //if weakest att dont multiply
-     if(num_near_zero == 2 || (att[(i + 1)%3] < att[i] || att[(i+2)%3] < att[i])){
-       a *= att[i];
-   }
-   }
-   return clamp(a, 0.0, 1.0);
-  }else return 0.0;
+  vec3 dir = pixelRay(pixel);
+  float t_near, t_far;
+  //the eye is inside of the box or the box is missed
+  if(!intersectBox(eye, dir, t_near, t_far) || t_near <= 0.0) return vec4(0);
+  return vec4(eye + t_near * dir, 1.0);
 }
-
-const vec3 skyColor = vec3(0.2, 0.2, 0.5);
-float testFunc(vec3 x){
-  vec3 p = x;
-  p.xy = p.xy * 0.5 + 0.5;
-  p.z = (p.z + 1.0)/3.0;
-  return noise(p.yz - p.x * p.y + p.z);
+//bilateral upsampling of the reduced resolution clouds: the bilinear weights
+//of the 4 nearest low resolution texels are scaled down with the distance
+//between their front face position and the one of this fragment, so clouds
+//do not bleed over the edges of the box
+vec4 upsampleClouds(vec3 frontside_pos){
+  ivec2 size = marchSize;
+  if(resolutionDivisor == 1.0){
+    vec4 clouds = texelFetch(lowres_tex, ivec2(gl_FragCoord.xy), 0);
+    return max(clouds, vec4(0));
+  }
+  vec2 p = gl_FragCoord.xy / resolutionDivisor - 0.5;
+  ivec2 base = ivec2(floor(p));
+  vec2 f = fract(p);
+  float eye_dist = max(distance(eye, frontside_pos), 0.1);
+  vec4 sum = vec4(0);
+  float weight_sum = 0.0;
+  for(int j = 0; j < 2; j++){
+    for(int i = 0; i < 2; i++){
+      ivec2 texel = clamp(base + ivec2(i, j), ivec2(0), size - 1);
+      vec4 clouds = texelFetch(lowres_tex, texel, 0);
+      //cleared to a negative alpha where the box was not rasterized
+      if(clouds.a < 0.0) continue;
+      vec4 texel_front = frontside((vec2(texel) + 0.5) * resolutionDivisor);
+      vec3 texel_pos = texel_front.a == 0.0 ? eye : texel_front.rgb;
+      float bilinear = (i == 0 ? 1.0 - f.x : f.x) * (j == 0 ? 1.0 - f.y : f.y);
+      float w = (bilinear + 1e-3) * exp(-10.0 * distance(texel_pos, frontside_pos) / eye_dist);
+      sum += w * clouds;
+      weight_sum += w;
+    }
+  }
+  return weight_sum > 0.0 ? sum / weight_sum : vec4(0);
 }
-//marches a ray to the sun to calculate how much light is hitting the point
-float transmittanceRay(vec3 start, float density){
-  const int shadowSteps = 10;
-  float res = 1.0; 
-  for(int i = 0; i < shadowSteps; i++){
-    vec3 pos = start + (i+1) * stepSize * sun_dir * 1.5;
-    if(pos.y >= domain_border_max.y || pos.y <= domain_border_min.y) break; 
-    float samp = testFunc(pos) * density;
-    res *= (1.0 - samp);
+//bilinear sample of the history at coord (in texels) that ignores texels
+//outside of the box, negative alpha if they make up most of the footprint
+vec4 sampleHistory(vec2 coord){
+  ivec2 size = marchSize;
+  vec2 p = coord - 0.5;
+  ivec2 base = ivec2(floor(p));
+  vec2 f = fract(p);
+  vec4 sum = vec4(0);
+  float weight_sum = 0.0;
+  for(int j = 0; j < 2; j++){
+    for(int i = 0; i < 2; i++){
+      vec4 history = texelFetch(history_tex, clamp(base + ivec2(i, j), ivec2(0), size - 1), 0);
+      if(history.a < 0.0) continue;
+      float w = (i == 0 ? 1.0 - f.x : f.x) * (j == 0 ? 1.0 - f.y : f.y);
+      sum += w * history;
+      weight_sum += w;
+    }
   }
-  return res;
+  return weight_sum > 0.5 ? sum / weight_sum : vec4(-1);
 }
-vec4 raymarching(vec3 start, vec3 dir, vec3 end){
-  const vec3 matcol = vec3(1);
-  const float stepPerc = stepSize / length(end-start);
-  const float density = stepSize * 30;
-  float transmittance = 1.0;
-  vec3 final = vec3(0);
-  for(float curr = 0.0; curr <= 1.0; curr += stepPerc){
-    vec3 samp = start + curr * dir * length(end-start);
-    float samp_dens = testFunc(samp) * density;
-    if(samp_dens > 0.0){
-      //hit now attenuate
-      float diffuse_co = transmittanceRay(samp, density) + 0.1;
-      final += matcol * diffuse_co * transmittance * samp_dens;
-      transmittance = (transmittance * (1.0 - samp_dens));
-      if(transmittance < 0.05) break;
+//clouds of a pixel that was not marched this frame: the history of the last
+//frame reprojected at the cloud depth of the nearest marched pixel, clamped to the range of the
+//marched pixels around it if the camera moved. Pixels outside of the box in the last frame or
+//outside of its view are disoccluded and take the nearest marched pixel.
+vec4 resolveClouds(vec3 frontside_pos){
+  ivec2 pixel = ivec2(gl_FragCoord.xy);
+  ivec2 subset_size = (marchSize + subsetStride - 1) / subsetStride;
+  ivec2 subset_texel = min(pixel / subsetStride, subset_size - 1);
+  vec4 fresh = texelFetch(subset_tex, subset_texel, 0);
+  if(pixel % subsetStride == subsetOffset) return max(fresh, vec4(0));
+  if(historyValid != 0){
+    float depth = texelFetch(subset_depth_tex, subset_texel, 0).r;
+    vec3 cloud_pos = frontside_pos + normalize(linspace - frontside_pos) * depth;
+    vec4 prev = prevmat * vec4(cloud_pos, 1.0);
+    vec2 uv = prev.xy / prev.w * 0.5 + 0.5;
+    if(prev.w > 0.0 && all(greaterThanEqual(uv, vec2(0))) && all(lessThan(uv, vec2(1)))){
+      vec2 history_coord = uv * vec2(marchSize);
+      vec4 history = sampleHistory(history_coord);
+      //a still camera keeps the history as it is
+      if(history.a >= 0.0 && distance(history_coord, gl_FragCoord.xy) < 0.01) return history;
+      if(history.a >= 0.0){
+        vec4 lo = vec4(1e10), hi = vec4(-1e10);
+        for(int j = -1; j <= 1; j++){
+          for(int i = -1; i <= 1; i++){
+            vec4 n = texelFetch(subset_tex, clamp(subset_texel + ivec2(i, j), ivec2(0), subset_size - 1), 0);
+            if(n.a < 0.0) continue;
+            lo = min(lo, n);
+            hi = max(hi, n);
+          }
+        }
+        if(hi.a >= 0.0) return clamp(history, lo, hi);
+      }
     }
   }
-  return vec4(final, 1.0 - transmittance);
+  return max(fresh, vec4(0));
 }
-
 void main(){
   if(backside == 0){
+#if defined(FRONTSIDE_DEPTH)
+    color = vec4(distance(eye, linspace));
+#elif defined(FRONTSIDE_BOX)
+    color = vec4((linspace - domain_border_min) / (domain_border_max - domain_border_min), 1.0);
+#else
     color = vec4(linspace, 1.0);
+#endif
   }else{
-    //raymarching
-    float back_border = onBorder(linspace);
-
-    vec2 tc = (gl_FragCoord.xy) / textureSize(frontside_tex, 0);
-    vec4 frontside_col = texture(frontside_tex, tc);
+    //pixel of the (reduced resolution) march this fragment stands for
+    vec2 march_coord = backside == 2
+        ? floor(gl_FragCoord.xy) * float(subsetStride) + vec2(subsetOffset) + 0.5
+        : gl_FragCoord.xy;
+    vec4 frontside_col = frontside(backside == 3 ? gl_FragCoord.xy : march_coord * resolutionDivisor);
     vec3 frontside_pos = frontside_col.a == 0.0 ? eye : frontside_col.rgb;
-
-    float front_border = onBorder(frontside_pos);
-    vec3 background = mix(skyColor, vec3(0.15), front_border);
-
-    float total_length = length(linspace - frontside_pos);
-    vec3 dir = normalize(linspace - frontside_pos);
-    vec4 final = raymarching(frontside_pos, dir, linspace);
-    final.rgb += (1.0 - final.a) * background;
-    color = vec4(mix(final.rgb, vec3(0.15), front_border), 1.0);
+    vec4 final;
+    if(backside == 3){
+      final = upsampleClouds(frontside_pos);
+    }else if(backside == 4){
+      color = resolveClouds(frontside_pos);
+      return;
+    }else{
+      //raymarching
+      vec3 dir = normalize(linspace - frontside_pos);
+      float depth;
+      float offset = rayJitter(march_coord);
+      final = march(frontside_pos, dir, linspace, offset, depth);
+      if(backside == 2){
+        //composited with the background after upsampling
+        color = final;
+        cloud_depth = depth;
+        return;
+      }
+    }
+    color = vec4(composite(final, frontside_pos), 1.0);
   }
 
 }
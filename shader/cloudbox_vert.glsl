@@ -1,8 +1,12 @@
 #version 430 
 in vec3 coords;
 out vec3 linspace;
-uniform mat4 cammat;
+#include "shader/frame.glsl"
+//scale and offset in normalized device coordinates that move the pixels of
+//a subset of the marched pixels onto the texel centers of a smaller target
+uniform vec4 subsetTransform;
 void main(){
   gl_Position = cammat * vec4(coords, 1.0);
+  gl_Position.xy = gl_Position.xy * subsetTransform.xy + subsetTransform.zw * gl_Position.w;
   linspace = coords;
 }
@@ -0,0 +1,38 @@
+//cloud density function, shared by the raymarcher and the occupancy grid
+uniform sampler3D shape_noise;
+uniform sampler3D detail_noise;
+
+const vec3 domain_border_min = vec3(-1, -1, -1);
+const vec3 domain_border_max = vec3(1,1,2);
+// tiles of the noise volumes per unit
+const float shape_scale = 0.4;
+const float detail_scale = 1.3;
+// fraction of the shape volume that is covered by clouds
+const float coverage = 0.35;
+// how strongly the detail volume erodes the edges of the shapes
+const float erosion = 0.35;
+float remap(float v, float lo, float hi, float new_lo, float new_hi){
+  return new_lo + (v - lo) / (hi - lo) * (new_hi - new_lo);
+}
+// fade out towards the bottom and top of the box, h in [0, 1]
+float heightFade(float h){
+  return smoothstep(0.0, 0.15, h) * smoothstep(1.0, 0.7, h);
+}
+// maximum of heightFade in [h0, h1]: it rises until 0.15, is 1 until 0.7 and
+// falls after that
+float maxHeightFade(float h0, float h1){
+  return heightFade(clamp(0.425, h0, h1));
+}
+// density before erosion, an upper bound of testFunc
+float coverageDensity(float shape){
+  return remap(shape, 1.0 - coverage, 1.0, 0.0, 1.0);
+}
+float testFunc(vec3 x){
+  float shape = texture(shape_noise, x * shape_scale).r;
+  float h = (x.y - domain_border_min.y) / (domain_border_max.y - domain_border_min.y);
+  float dens = coverageDensity(shape * heightFade(h));
+  if(dens <= 0.0) return 0.0;
+  // the detail volume is only fetched inside of clouds
+  float detail = texture(detail_noise, x * detail_scale).r;
+  return max(dens - (1.0 - detail) * erosion * (1.0 - dens), 0.0);
+}
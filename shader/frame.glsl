@@ -0,0 +1,14 @@
+//parameters of the frame, uploaded once per frame into a uniform buffer. The
+//layout has to match frame_params in renderer.cpp.
+layout(std140, binding = 0) uniform frame_params {
+  mat4 cammat;
+  mat4 inv_cammat;
+  vec3 eye;
+  float stepSize;
+  vec2 viewport;
+  float time;
+  //added to the blue noise every frame, negative disables the ray jitter
+  float jitterOffset;
+  //size of the reduced resolution targets, their textures can be larger
+  ivec2 marchSize;
+};
@@ -0,0 +1,24 @@
+#version 430
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+// transmittance towards the sun at the texel centers of the light volume
+uniform float stepSize;
+//offsets the shadow rays of neighbouring texels by blue noise
+uniform int jitter;
+uniform sampler2D blue_noise;
+layout(binding = 0, r16f) uniform writeonly image3D light;
+#include "shader/density.glsl"
+#include "shader/lighting.glsl"
+void main(){
+  ivec3 size = imageSize(light);
+  ivec3 texel = ivec3(gl_GlobalInvocationID);
+  if(any(greaterThanEqual(texel, size))) return;
+  vec3 pos = domain_border_min + (vec3(texel) + 0.5) / vec3(size)
+           * (domain_border_max - domain_border_min);
+  float offset = 0.0;
+  if(jitter != 0){
+    //golden ratio steps decorrelate the layers
+    float noise = texelFetch(blue_noise, texel.xy % textureSize(blue_noise, 0), 0).r;
+    offset = fract(noise + float(texel.z) * 0.618034);
+  }
+  imageStore(light, texel, vec4(transmittanceRay(pos, stepSize * extinction, stepSize, offset)));
+}
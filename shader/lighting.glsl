@@ -0,0 +1,28 @@
+//sun lighting, needs density.glsl. The constants can be specialized by the
+//defines of the program variant.
+#ifndef SUN_DIR
+#define SUN_DIR vec3(0, 1, 0)
+#endif
+#ifndef EXTINCTION
+#define EXTINCTION 30.0
+#endif
+#ifndef SHADOW_STEPS
+#define SHADOW_STEPS 10
+#endif
+const vec3 sun_dir = normalize(SUN_DIR);
+//extinction per unit length of density 1, the fixed step march uses the linear
+//approximation stepSize * extinction as opacity
+const float extinction = EXTINCTION;
+//marches a ray to the sun to calculate how much light is hitting the point,
+//the samples are moved offset (in [0, 1)) steps towards the start
+float transmittanceRay(vec3 start, float density, float stepSize, float offset){
+  const int shadowSteps = SHADOW_STEPS;
+  float res = 1.0; 
+  for(int i = 0; i < shadowSteps; i++){
+    vec3 pos = start + (i + 1 - offset) * stepSize * sun_dir * 1.5;
+    if(pos.y >= domain_border_max.y || pos.y <= domain_border_min.y) break; 
+    float samp = testFunc(pos) * density;
+    res *= (1.0 - samp);
+  }
+  return res;
+}
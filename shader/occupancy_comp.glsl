@@ -0,0 +1,44 @@
+#version 430
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+// level 0 is computed from the density function, every other level is the
+// maximum of the 2x2x2 cells of the level below
+uniform int level;
+layout(binding = 0, r8ui) uniform writeonly uimage3D cells;
+layout(binding = 1, r8ui) uniform readonly uimage3D finer_cells;
+#include "shader/density.glsl"
+
+// conservative occupancy of one cell: the maximum of the linearly filtered
+// shape volume over a box is the maximum of the texels covering it
+uint occupied(ivec3 cell, ivec3 size){
+  vec3 extent = domain_border_max - domain_border_min;
+  vec3 cell_min = domain_border_min + vec3(cell) / vec3(size) * extent;
+  vec3 cell_max = cell_min + extent / vec3(size);
+  ivec3 res = textureSize(shape_noise, 0);
+  ivec3 lo = ivec3(floor(cell_min * shape_scale * res - 0.5));
+  ivec3 hi = ivec3(floor(cell_max * shape_scale * res - 0.5)) + 1;
+  float shape = 0.0;
+  for(int z = lo.z; z <= hi.z; z++)
+    for(int y = lo.y; y <= hi.y; y++)
+      for(int x = lo.x; x <= hi.x; x++){
+        // % is undefined for negative operands in GLSL, mod is not
+        ivec3 texel = ivec3(mod(vec3(x, y, z), vec3(res)));
+        shape = max(shape, texelFetch(shape_noise, texel, 0).r);
+      }
+  float h0 = (cell_min.y - domain_border_min.y) / extent.y;
+  float h1 = (cell_max.y - domain_border_min.y) / extent.y;
+  // erosion only ever lowers the density
+  return coverageDensity(shape * maxHeightFade(h0, h1)) > 0.0 ? 1u : 0u;
+}
+void main(){
+  ivec3 size = imageSize(cells);
+  ivec3 cell = ivec3(gl_GlobalInvocationID);
+  if(any(greaterThanEqual(cell, size))) return;
+  uint occ = 0u;
+  if(level == 0){
+    occ = occupied(cell, size);
+  }else{
+    for(int i = 0; i < 8; i++)
+      occ = max(occ, imageLoad(finer_cells, cell * 2 + ivec3(i & 1, (i >> 1) & 1, i >> 2)).r);
+  }
+  imageStore(cells, cell, uvec4(occ));
+}
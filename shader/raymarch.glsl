@@ -0,0 +1,210 @@
+//raymarching through the cloud box, shared by the fragment and the compute
+//shader backend, needs frame.glsl, density.glsl and lighting.glsl. Defining
+//ADAPTIVE_STEPS selects raymarchingAdaptive in march.
+#ifndef TRANSMITTANCE_CUTOFF
+#define TRANSMITTANCE_CUTOFF 0.05
+#endif
+//rays stop once less light than this gets through
+const float transmittanceCutoff = TRANSMITTANCE_CUTOFF;
+uniform usampler3D occupancy;
+uniform sampler3D light_volume;
+uniform sampler2D blue_noise;
+
+const vec3 skyColor = vec3(0.2, 0.2, 0.5);
+float onBorder(vec3 pos){
+  const float border_size = 0.002 * length(eye - pos);
+  int num_near_zero = 0;
+  float att[3];
+  int index = 0;
+  for(int i = 0; i < 3; i++){
+    if(pos[i] <= domain_border_min[i] + border_size){
+      att[num_near_zero++] = 1.0 - ((pos[i] - domain_border_min[i]) / border_size);
+    }
+    if(pos[i] >= domain_border_max[i]-border_size){
+      att[num_near_zero++] = (pos[i] - (domain_border_max[i] - border_size)) / border_size;
+    }
+  }
+  float a = 1.0;
+  if(num_near_zero > 1){
+   for(int i = 0; i < num_near_zero; i++){
+     //if weakest att dont multiply
+     if(num_near_zero == 2 || (att[(i + 1)%3] < att[i] || att[(i+2)%3] < att[i])){
+       a *= att[i];
+   }
+   }
+   return clamp(a, 0.0, 1.0);
+  }else return 0.0;
+}
+//clouds in front of the sky and the darkened edges of the box, frontside_pos
+//is where the ray enters the box
+vec3 composite(vec4 clouds, vec3 frontside_pos){
+  float front_border = onBorder(frontside_pos);
+  vec3 background = mix(skyColor, vec3(0.15), front_border);
+  clouds.rgb += (1.0 - clouds.a) * background;
+  return mix(clouds.rgb, vec3(0.15), front_border);
+}
+//slab test of the ray origin + t * dir against the box, false if it is missed
+bool intersectBox(vec3 origin, vec3 dir, out float t_near, out float t_far){
+  //a zero component would give 0/0 for an origin on the plane of its slab
+  dir = mix(dir, vec3(1e-20), equal(dir, vec3(0.0)));
+  vec3 t0 = (domain_border_min - origin) / dir;
+  vec3 t1 = (domain_border_max - origin) / dir;
+  vec3 tmin = min(t0, t1), tmax = max(t0, t1);
+  t_near = max(max(tmin.x, tmin.y), tmin.z);
+  t_far = min(min(tmax.x, tmax.y), tmax.z);
+  return t_near <= t_far && t_far > 0.0;
+}
+//light reaching pos from the sun, precomputed by transmittanceRay
+float sunLight(vec3 pos){
+  return texture(light_volume, (pos - domain_border_min) / (domain_border_max - domain_border_min)).r;
+}
+//fraction of a step the ray of the pixel starts late, so the banding of
+//large steps becomes high frequency noise that changes every frame
+float rayJitter(vec2 pixel){
+  if(jitterOffset < 0.0) return 0.0;
+  float noise = texelFetch(blue_noise, ivec2(pixel) % textureSize(blue_noise, 0), 0).r;
+  return fract(noise + jitterOffset);
+}
+//distance from pos along dir to the exit of the coarsest empty cell of the
+//occupancy grid containing pos, 0 if the finest cell is occupied
+float emptySpace(vec3 pos, vec3 dir){
+  vec3 extent = domain_border_max - domain_border_min;
+  vec3 uvw = (pos - domain_border_min) / extent;
+  for(int level = textureQueryLevels(occupancy) - 1; level >= 0; level--){
+    //derived from the base level, textureSize with a non uniform level is not
+    //reliable on every driver
+    ivec3 size = max(textureSize(occupancy, 0) >> level, ivec3(1));
+    ivec3 cell = clamp(ivec3(uvw * size), ivec3(0), size - 1);
+    if(texelFetch(occupancy, cell, level).r == 0u){
+      vec3 cell_min = domain_border_min + vec3(cell) / vec3(size) * extent;
+      vec3 cell_max = cell_min + extent / vec3(size);
+      vec3 exit = mix(cell_min, cell_max, step(0.0, dir));
+      vec3 t = vec3(1e10);
+      for(int i = 0; i < 3; i++)
+        if(dir[i] != 0.0) t[i] = (exit[i] - pos[i]) / dir[i];
+      return max(min(min(t.x, t.y), t.z), 0.0);
+    }
+  }
+  return 0.0;
+}
+//state of a ray between the parts it is marched in: the light and the
+//transmittance gathered so far, the opacity weighted sum of the sample
+//distances and where the next sample is taken. raymarching keeps t as a
+//fraction of the ray, raymarchingAdaptive as a distance and also counts its
+//samples and keeps its step mode.
+struct RayState {
+  vec3 light;
+  float transmittance;
+  float depth_sum;
+  float t;
+  int samples;
+  bool fine;
+  int empty;
+};
+//marches at most maxSamples samples (without a limit if 0) from the state,
+//true once the ray is done
+bool raymarching(inout RayState ray, vec3 start, vec3 dir, vec3 end, float offset, int maxSamples){
+  const vec3 matcol = vec3(1);
+  const float stepPerc = stepSize / length(end-start);
+  const float density = stepSize * extinction;
+  for(int i = 0; ray.t <= 1.0; ray.t += stepPerc, i++){
+    if(maxSamples > 0 && i >= maxSamples) return false;
+    vec3 samp = start + ray.t * dir * length(end-start);
+    //skip whole steps through empty cells, so the samples stay on the same
+    //positions as without skipping
+    float skip = emptySpace(samp, dir);
+    if(skip > 0.0){
+      ray.t += floor(skip / stepSize) * stepPerc;
+      continue;
+    }
+    float samp_dens = testFunc(samp) * density;
+    if(samp_dens > 0.0){
+      //hit now attenuate
+      float diffuse_co = sunLight(samp) + 0.1;
+      ray.light += matcol * diffuse_co * ray.transmittance * samp_dens;
+      ray.depth_sum += ray.t * length(end-start) * ray.transmittance * samp_dens;
+      ray.transmittance = (ray.transmittance * (1.0 - samp_dens));
+      if(ray.transmittance < transmittanceCutoff) return true;
+    }
+  }
+  return true;
+}
+//march with a step size that is coarse outside and fine inside of clouds and
+//grows with the distance to the eye and with the accumulated opacity. The
+//opacity of each sample is integrated over its actual step length, so the
+//image does not depend on where the step size changes.
+bool raymarchingAdaptive(inout RayState ray, vec3 start, vec3 dir, vec3 end, float offset, int maxSamples){
+  const vec3 matcol = vec3(1);
+  const int totalSamples = 1024;
+  //consecutive empty fine samples after which the march coarsens again
+  const int emptyToCoarse = 4;
+  float len = length(end - start);
+  const float t0 = offset * stepSize;
+  for(int i = 0; ray.samples < totalSamples && ray.t <= len; ray.samples++, i++){
+    if(maxSamples > 0 && i >= maxSamples) return false;
+    vec3 samp = start + ray.t * dir;
+    float skip = emptySpace(samp, dir);
+    if(skip > 0.0){
+      ray.t += skip + 1e-4;
+      ray.fine = false;
+      continue;
+    }
+    float dt = stepSize * (1.0 + 0.15 * distance(eye, samp))
+             * mix(1.0, 3.0, 1.0 - ray.transmittance);
+    dt = min(dt, 4.0 * stepSize);
+    float coarse_dt = 3.0 * dt;
+    float dens = testFunc(samp);
+    if(dens <= 0.0){
+      if(ray.fine && ++ray.empty >= emptyToCoarse) ray.fine = false;
+      ray.t += ray.fine ? dt : coarse_dt;
+      continue;
+    }
+    if(!ray.fine && ray.t > t0){
+      //entered a cloud with a coarse step, go back and refine
+      ray.fine = true;
+      ray.empty = 0;
+      ray.t = max(ray.t - coarse_dt + dt, t0);
+      continue;
+    }
+    ray.fine = true;
+    ray.empty = 0;
+    float alpha = 1.0 - exp(-dens * extinction * dt);
+    float diffuse_co = sunLight(samp) + 0.1;
+    ray.light += matcol * diffuse_co * ray.transmittance * alpha;
+    ray.depth_sum += ray.t * ray.transmittance * alpha;
+    ray.transmittance *= 1.0 - alpha;
+    if(ray.transmittance < transmittanceCutoff) return true;
+    ray.t += dt;
+  }
+  return true;
+}
+//state of a ray before its first sample, offset is the fraction of a step
+//the ray starts late
+RayState beginRay(vec3 start, vec3 end, float offset){
+#ifdef ADAPTIVE_STEPS
+  float t = offset * stepSize;
+#else
+  float t = offset * (stepSize / length(end-start));
+#endif
+  return RayState(vec3(0), 1.0, 0.0, t, 0, false, 0);
+}
+//continues the march of the program variant for at most maxSamples samples
+//(without a limit if 0), true once the ray is done
+bool marchSteps(inout RayState ray, vec3 start, vec3 dir, vec3 end, float offset, int maxSamples){
+#ifdef ADAPTIVE_STEPS
+  return raymarchingAdaptive(ray, start, dir, end, offset, maxSamples);
+#else
+  return raymarching(ray, start, dir, end, offset, maxSamples);
+#endif
+}
+//the clouds of a finished ray and their opacity weighted distance from start
+vec4 finishRay(RayState ray, vec3 start, vec3 end, out float depth){
+  depth = ray.transmittance < 0.99 ? ray.depth_sum / (1.0 - ray.transmittance) : 0.5 * length(end - start);
+  return vec4(ray.light, 1.0 - ray.transmittance);
+}
+//the raymarcher of the program variant
+vec4 march(vec3 start, vec3 dir, vec3 end, float offset, out float depth){
+  RayState ray = beginRay(start, end, offset);
+  marchSteps(ray, start, dir, end, offset, 0);
+  return finishRay(ray, start, end, depth);
+}
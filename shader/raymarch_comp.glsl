@@ -0,0 +1,167 @@
+#version 430
+//compute shader backend of the raymarcher, marches 8x8 pixel tiles.
+//stage 0 classifies the tiles: the ray bounds of the tile are reduced in shared
+//memory and one walk through the occupancy grid checks the span of the whole
+//tile. Tiles whose rays miss the box or only pass through empty cells are
+//written right away, the other tiles are appended to the output tile list.
+//stage 1 marches the tiles of the input tile list (which is also the indirect
+//dispatch) for at most sampleBudget samples per ray. Rays that are not done
+//keep their state in ray_light and ray_march, and their tiles are appended to
+//the output list, so the next dispatch only marches those tiles. Tiles whose
+//rays all saturated or left the box drop out.
+layout(local_size_x = 8, local_size_y = 8) in;
+uniform int stage;
+//stage 1: continues the rays from ray_state instead of starting them
+uniform int resume;
+//stage 1: samples per ray of this dispatch, 0 marches the rays to their end
+uniform int sampleBudget;
+layout(binding = 0, rgba8) uniform writeonly image2D target;
+//light and transmittance, and depth sum, t, samples and step mode of the
+//rays that are not done, the transmittance is -1 for the done ones
+layout(binding = 1, rgba32f) uniform image2D ray_light;
+layout(binding = 2, rgba32f) uniform image2D ray_march;
+layout(std430, binding = 0) readonly buffer tile_input {
+  uint input_groups[3];
+  uint input_tiles[];
+};
+layout(std430, binding = 1) buffer tile_output {
+  uint num_groups_x, num_groups_y, num_groups_z;
+  uint tiles[];
+};
+#include "shader/frame.glsl"
+#include "shader/density.glsl"
+#include "shader/lighting.glsl"
+#include "shader/raymarch.glsl"
+//stage 0: a ray of the tile passes through occupied cells, stage 1: a ray of
+//the tile is not done
+shared uint tile_occupied;
+shared uvec2 tile;
+//stage 0: the span of the tile, the smallest entry and the largest exit of
+//its rays that hit the box, and how far the directions of the rays are from
+//the axis of the tile. Kept as the bits of the non negative floats, which
+//order the same way, for the atomics.
+shared uint span_near, span_far, spread;
+
+//direction of the ray through pos in window coordinates
+vec3 pixelRay(vec2 pos, vec2 size){
+  vec4 far_pos = inv_cammat * vec4(pos / size * 2.0 - 1.0, 1.0, 1.0);
+  return normalize(far_pos.xyz / far_pos.w - eye);
+}
+//true if every cell of the occupancy grid overlapping the box lo to hi is
+//empty, on the coarsest level where that takes at most 2x2x2 cells
+bool emptyBox(vec3 lo, vec3 hi){
+  vec3 extent = domain_border_max - domain_border_min;
+  vec3 uvw_lo = (lo - domain_border_min) / extent;
+  vec3 uvw_hi = (hi - domain_border_min) / extent;
+  for(int level = textureQueryLevels(occupancy) - 1; level >= 0; level--){
+    ivec3 size = max(textureSize(occupancy, 0) >> level, ivec3(1));
+    ivec3 cell_lo = clamp(ivec3(floor(uvw_lo * vec3(size))), ivec3(0), size - 1);
+    ivec3 cell_hi = clamp(ivec3(floor(uvw_hi * vec3(size))), ivec3(0), size - 1);
+    //the finer levels take even more cells
+    if(any(greaterThan(cell_hi - cell_lo, ivec3(1)))) return false;
+    bool empty = true;
+    for(int i = 0; i < 8; i++){
+      ivec3 cell = min(cell_lo + ivec3(i & 1, (i >> 1) & 1, i >> 2), cell_hi);
+      if(texelFetch(occupancy, cell, level).r != 0u) empty = false;
+    }
+    if(empty) return true;
+  }
+  return false;
+}
+//true if no ray of the tile touches an occupied cell between t_near and t_far.
+//At the distance t every ray is within t * spread of eye + t * axis, so the
+//walk along the axis checks the bounding box of that cone for every step,
+//halving the steps that leave the empty cells. Where the axis is outside of
+//the box the step goes to where it enters the box or to t_far.
+bool emptyTile(vec3 axis, float spread, float t_near, float t_far){
+  float axis_near, axis_far;
+  bool axis_hit = intersectBox(eye, axis, axis_near, axis_far);
+  float t = t_near;
+  for(int i = 0; i < 64 && t < t_far; i++){
+    float probe = t + 1e-4;
+    float next = !axis_hit || probe >= axis_far ? t_far
+               : probe < axis_near ? axis_near
+               : probe + emptySpace(eye + probe * axis, axis);
+    next = min(next, t_far);
+    vec3 pos = eye + t * axis;
+    for(int j = 0;; j++){
+      vec3 next_pos = eye + next * axis;
+      float radius = next * spread + 1e-4;
+      if(emptyBox(min(pos, next_pos) - radius, max(pos, next_pos) + radius)) break;
+      if(j == 3) return false;
+      next = 0.5 * (t + next);
+    }
+    t = next;
+  }
+  return t >= t_far;
+}
+void main(){
+  ivec2 size = ivec2(viewport);
+  ivec2 local = ivec2(gl_LocalInvocationID.xy);
+  if(gl_LocalInvocationIndex == 0){
+    tile = stage == 0 ? gl_WorkGroupID.xy
+                      : uvec2(input_tiles[gl_WorkGroupID.x] & 0xFFFFu, input_tiles[gl_WorkGroupID.x] >> 16);
+    tile_occupied = 0u;
+    span_near = floatBitsToUint(1e30);
+    span_far = spread = 0u;
+  }
+  barrier();
+  ivec2 pixel = ivec2(tile) * 8 + local;
+  vec3 dir = pixelRay(vec2(pixel) + 0.5, vec2(size));
+  float t_near, t_far;
+  bool hit = intersectBox(eye, dir, t_near, t_far);
+  t_near = max(t_near, 0.0);
+  if(stage == 0){
+    vec3 axis = pixelRay(vec2(tile) * 8.0 + 4.0, vec2(size));
+    if(hit && all(lessThan(pixel, size))){
+      atomicMin(span_near, floatBitsToUint(t_near));
+      atomicMax(span_far, floatBitsToUint(t_far));
+      atomicMax(spread, floatBitsToUint(distance(dir, axis)));
+    }
+    barrier();
+    //tiles whose rays all miss the box have an empty span
+    if(gl_LocalInvocationIndex == 0 && span_near <= span_far &&
+       !emptyTile(axis, uintBitsToFloat(spread), uintBitsToFloat(span_near), uintBitsToFloat(span_far))){
+      tile_occupied = 1u;
+      tiles[atomicAdd(num_groups_x, 1u)] = tile.x | (tile.y << 16);
+    }
+    barrier();
+    //the rays of occupied tiles are written by stage 1
+    if(tile_occupied != 0u || any(greaterThanEqual(pixel, size))) return;
+    imageStore(target, pixel, vec4(hit ? composite(vec4(0), eye + t_near * dir) : skyColor, 1.0));
+    return;
+  }
+  bool done = true;
+  if(all(lessThan(pixel, size))){
+    RayState ray;
+    if(resume != 0){
+      vec4 light = imageLoad(ray_light, pixel);
+      vec4 state = imageLoad(ray_march, pixel);
+      ray = RayState(light.rgb, light.a, state.x, state.y, int(state.z), state.w > 0.0, max(int(state.w) - 1, 0));
+    }
+    if(!hit){
+      imageStore(target, pixel, vec4(skyColor, 1.0));
+    }else if(resume == 0 || ray.transmittance >= 0.0){
+      vec3 start = eye + t_near * dir;
+      vec3 end = eye + t_far * dir;
+      float offset = rayJitter(vec2(pixel) + 0.5);
+      if(resume == 0) ray = beginRay(start, end, offset);
+      done = marchSteps(ray, start, dir, end, offset, sampleBudget);
+      if(done){
+        float depth;
+        vec4 final = finishRay(ray, start, end, depth);
+        imageStore(target, pixel, vec4(composite(final, start), 1.0));
+      }
+    }
+    if(done){
+      imageStore(ray_light, pixel, vec4(-1));
+    }else{
+      imageStore(ray_light, pixel, vec4(ray.light, ray.transmittance));
+      imageStore(ray_march, pixel, vec4(ray.depth_sum, ray.t, float(ray.samples), ray.fine ? float(ray.empty + 1) : 0.0));
+      atomicOr(tile_occupied, 1u);
+    }
+  }
+  barrier();
+  if(gl_LocalInvocationIndex == 0 && tile_occupied != 0u)
+    tiles[atomicAdd(num_groups_x, 1u)] = tile.x | (tile.y << 16);
+}
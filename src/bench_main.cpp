@@ -0,0 +1,204 @@
+#include "framebuffer.hpp"
+#include "headless.hpp"
+#include "renderer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+struct frame_sample {
+  double cpu, backside, raymarch;
+};
+static void usage(const char *name) {
+  std::cerr << "usage: " << name
+            << " [--frames N] [--warmup N] [--resolutions WxH,WxH,...]\n"
+               "       [--step-size S] [--adaptive-steps 0|1] "
+               "[--noise-resolution N]\n"
+               "       [--noise-threads N] [--resolution-divisor 1|2|4] "
+               "[--temporal-subset 1|4|16]\n"
+               "       [--jitter 0|1] [--single-pass 0|1] [--compute 0|1] "
+               "[--shadow-steps N]\n"
+               "       [--frontside-format "
+               "rgba32f|rgba16f|rgb10_a2|r32f|r16f] [--output FILE]"
+            << std::endl;
+}
+/**
+ *  Nearest rank percentile of an already sorted list
+ */
+static double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty())
+    return 0;
+  size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+  return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+}
+static void write_stats(std::ostream &out, const char *name,
+                        std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  double sum = 0;
+  for (double v : values)
+    sum += v;
+  out << "\"" << name << "\": {\"mean\": " << sum / values.size()
+      << ", \"p50\": " << percentile(values, 50)
+      << ", \"p95\": " << percentile(values, 95)
+      << ", \"p99\": " << percentile(values, 99) << "}";
+}
+/**
+ *  Fixed camera path, a full orbit around the box while the elevation and the
+ * distance oscillate. Only depends on the frame index.
+ */
+static void set_camera(int frame, int frames, float step_size) {
+  const float t = (float)frame / frames;
+  cloud_renderer::set_view_angle_x(360.f * t);
+  cloud_renderer::set_view_angle_y(60.f + 25.f * std::sin(2 * M_PI * t));
+  cloud_renderer::set_radius(1.f + 0.3f * std::cos(2 * M_PI * t));
+  cloud_renderer::set_step_size(step_size);
+}
+int main(int argc, char *argv[]) {
+  int frames = 120, warmup = 10, noise_resolution = 128, noise_threads = 0,
+      adaptive_steps = 0, resolution_divisor = 1, temporal_subset = 1,
+      jitter = 0, single_pass = 1, compute = 0, shadow_steps = 10;
+  float step_size = 0.02;
+  std::string resolutions = "640x480,1280x720,1920x1080", output = "",
+              frontside_format = "rgba32f";
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    const char *val = argv[++i];
+    if (arg == "--frames")
+      frames = std::stoi(val);
+    else if (arg == "--warmup")
+      warmup = std::stoi(val);
+    else if (arg == "--resolutions")
+      resolutions = val;
+    else if (arg == "--step-size")
+      step_size = std::stof(val);
+    else if (arg == "--adaptive-steps")
+      adaptive_steps = std::stoi(val);
+    else if (arg == "--noise-resolution")
+      noise_resolution = std::stoi(val);
+    else if (arg == "--noise-threads")
+      noise_threads = std::stoi(val);
+    else if (arg == "--resolution-divisor")
+      resolution_divisor = std::stoi(val);
+    else if (arg == "--temporal-subset")
+      temporal_subset = std::stoi(val);
+    else if (arg == "--jitter")
+      jitter = std::stoi(val);
+    else if (arg == "--single-pass")
+      single_pass = std::stoi(val);
+    else if (arg == "--compute")
+      compute = std::stoi(val);
+    else if (arg == "--shadow-steps")
+      shadow_steps = std::stoi(val);
+    else if (arg == "--frontside-format")
+      frontside_format = val;
+    else if (arg == "--output")
+      output = val;
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  std::vector<std::pair<int, int>> sizes;
+  std::stringstream res_list(resolutions);
+  for (std::string res; std::getline(res_list, res, ',');) {
+    size_t x = res.find('x');
+    if (x == std::string::npos) {
+      usage(argv[0]);
+      return 1;
+    }
+    sizes.push_back({std::stoi(res.substr(0, x)), std::stoi(res.substr(x + 1))});
+  }
+  const int frontside_internal = headless::internal_format(frontside_format);
+  if (!frontside_internal) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!headless::create_context())
+    return 1;
+  cloud_renderer::set_adaptive_steps(adaptive_steps);
+  cloud_renderer::set_resolution_divisor(resolution_divisor);
+  cloud_renderer::set_temporal_subset(temporal_subset);
+  cloud_renderer::set_ray_jitter(jitter);
+  cloud_renderer::set_single_pass(single_pass);
+  cloud_renderer::set_compute_backend(compute);
+  cloud_renderer::set_shadow_steps(shadow_steps);
+  cloud_renderer::set_frontside_format(frontside_internal);
+  cloud_renderer::set_noise_resolution(noise_resolution);
+  cloud_renderer::set_noise_threads(noise_threads);
+  cloud_renderer::init();
+  cloud_renderer::set_profiling(true);
+  std::stringstream json;
+  json << "{\"frames\": " << frames << ", \"warmup\": " << warmup
+       << ", \"step_size\": " << step_size
+       << ", \"adaptive_steps\": " << adaptive_steps
+       << ", \"resolution_divisor\": " << resolution_divisor
+       << ", \"temporal_subset\": " << temporal_subset
+       << ", \"jitter\": " << jitter
+       << ", \"single_pass\": " << single_pass
+       << ", \"shadow_steps\": " << shadow_steps
+       << ", \"frontside_format\": \"" << frontside_format << "\""
+       << ", \"compute\": " << compute
+       << ", \"noise_resolution\": " << noise_resolution
+       << ", \"noise_load_ms\": " << cloud_renderer::last_noise_load_time()
+       << ", \"runs\": [";
+  for (size_t r = 0; r < sizes.size(); r++) {
+    const auto [width, height] = sizes[r];
+    cloud_renderer::resize(width, height);
+    Framebuffer *target = new Framebuffer(width, height);
+    target->generateColorTexture(GL_RGBA8);
+    target->generateDepthBuffer();
+    std::vector<frame_sample> samples;
+    samples.reserve(frames);
+    for (int frame = -warmup; frame < frames; frame++) {
+      set_camera(std::max(frame, 0), frames, step_size);
+      target->bind();
+      const auto start = std::chrono::steady_clock::now();
+      cloud_renderer::render();
+      const auto end = std::chrono::steady_clock::now();
+      target->unbind();
+      // blocks until the frame has finished on the gpu
+      cloud_renderer::pass_timings gpu = cloud_renderer::last_pass_timings();
+      if (frame >= 0)
+        samples.push_back(
+            {std::chrono::duration<double, std::milli>(end - start).count(),
+             gpu.backside, gpu.raymarch});
+    }
+    delete target;
+    std::vector<double> cpu, backside, raymarch, gpu_total;
+    for (const frame_sample &s : samples) {
+      cpu.push_back(s.cpu);
+      backside.push_back(s.backside);
+      raymarch.push_back(s.raymarch);
+      gpu_total.push_back(s.backside + s.raymarch);
+    }
+    json << (r ? ", " : "") << "{\"width\": " << width
+         << ", \"height\": " << height << ", ";
+    write_stats(json, "cpu_ms", cpu);
+    json << ", ";
+    write_stats(json, "gpu_backside_ms", backside);
+    json << ", ";
+    write_stats(json, "gpu_raymarch_ms", raymarch);
+    json << ", ";
+    write_stats(json, "gpu_total_ms", gpu_total);
+    json << ", \"samples\": [";
+    for (size_t i = 0; i < samples.size(); i++)
+      json << (i ? ", " : "") << "[" << samples[i].cpu << ", "
+           << samples[i].backside << ", " << samples[i].raymarch << "]";
+    json << "]}";
+  }
+  json << "]}\n";
+  cloud_renderer::cleanup();
+  headless::destroy_context();
+  if (output.empty())
+    std::cout << json.str();
+  else
+    std::ofstream(output) << json.str();
+  return 0;
+}
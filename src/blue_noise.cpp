@@ -0,0 +1,100 @@
+#include "blue_noise.hpp"
+#include <algorithm>
+#include <cmath>
+#include <random>
+namespace {
+/**
+ *  Binary pattern with the energy of every pixel, the sum of a gaussian of the
+ * (wrapped) distance to all set pixels
+ */
+struct pattern {
+  int size;
+  std::vector<float> kernel, energy;
+  std::vector<bool> set;
+  pattern(int size) : size(size), energy(size * size), set(size * size) {
+    const float sigma = 1.5f;
+    kernel.resize(size * size);
+    for (int y = 0; y < size; y++)
+      for (int x = 0; x < size; x++) {
+        const int dx = std::min(x, size - x), dy = std::min(y, size - y);
+        kernel[y * size + x] =
+            std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+      }
+  }
+  void toggle(int i) {
+    set[i] = !set[i];
+    const float sign = set[i] ? 1.f : -1.f;
+    const int px = i % size, py = i / size;
+    for (int y = 0; y < size; y++) {
+      const int ky = (y - py + size) % size;
+      for (int x = 0; x < size; x++)
+        energy[y * size + x] +=
+            sign * kernel[ky * size + (x - px + size) % size];
+    }
+  }
+  // set pixel with the highest energy
+  int tightest_cluster() const {
+    int best = -1;
+    for (int i = 0; i < size * size; i++)
+      if (set[i] && (best < 0 || energy[i] > energy[best]))
+        best = i;
+    return best;
+  }
+  // unset pixel with the lowest energy
+  int largest_void() const {
+    int best = -1;
+    for (int i = 0; i < size * size; i++)
+      if (!set[i] && (best < 0 || energy[i] < energy[best]))
+        best = i;
+    return best;
+  }
+};
+} // namespace
+std::string blue_noise::description(int size, unsigned int seed) {
+  return "blue_noise v" + std::to_string(version) +
+         " size=" + std::to_string(size) + " seed=" + std::to_string(seed);
+}
+std::vector<float> blue_noise::generate(int size, unsigned int seed) {
+  const int n = size * size;
+  // initial binary pattern: a tenth of the pixels at random
+  pattern initial(size);
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> pixel(0, n - 1);
+  int ones = 0;
+  while (ones < n / 10) {
+    int i = pixel(rng);
+    if (!initial.set[i]) {
+      initial.toggle(i);
+      ones++;
+    }
+  }
+  // move the tightest cluster into the largest void until that is the same
+  // pixel
+  for (;;) {
+    const int cluster = initial.tightest_cluster();
+    initial.toggle(cluster);
+    const int space = initial.largest_void();
+    initial.toggle(space);
+    if (space == cluster)
+      break;
+  }
+  std::vector<int> rank(n);
+  // ranks of the initial pattern by removing its tightest clusters
+  pattern p = initial;
+  for (int r = ones - 1; r >= 0; r--) {
+    const int cluster = p.tightest_cluster();
+    p.toggle(cluster);
+    rank[cluster] = r;
+  }
+  // remaining ranks by filling the largest voids
+  p = initial;
+  for (int r = ones; r < n; r++) {
+    const int space = p.largest_void();
+    p.toggle(space);
+    rank[space] = r;
+  }
+  std::vector<float> result(n);
+  for (int i = 0; i < n; i++)
+    result[i] = (float)rank[i] / n;
+  return result;
+}
@@ -0,0 +1,23 @@
+#ifndef BLUE_NOISE_HPP
+#define BLUE_NOISE_HPP
+#include <string>
+#include <vector>
+/**
+ *  Tiling 2D blue noise (a dither mask without low frequencies) generated with
+ * Ulichney's void-and-cluster method. Used to offset the start of the rays, so
+ * the banding of large steps turns into high frequency noise.
+ */
+namespace blue_noise {
+// has to be increased whenever the generated noise changes, invalidates caches
+constexpr int version = 1;
+/**
+ *  Unique description of the mask generated with the parameters, e.g. as a
+ * cache key
+ */
+std::string description(int size, unsigned int seed);
+/**
+ *  size^2 single channel texels, every rank / size^2 in [0, 1) appears once
+ */
+std::vector<float> generate(int size, unsigned int seed);
+} // namespace blue_noise
+#endif
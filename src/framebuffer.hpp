@@ -2,59 +2,110 @@
 #include <optional>
 #ifndef FRAMEBUFFER_HPP
 #define FRAMEBUFFER_HPP
+#include "gl_state.hpp"
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <vector>
+/**
+ *  A framebuffer whose generated attachments have immutable storage. The
+ * storage is allocated in steps of granularity pixels and only reallocated
+ * once the size grows beyond it or shrinks to half of it, in between bind sets
+ * the viewport to the used part (so shaders have to get the size from
+ * getSize, not from textureSize).
+ */
 class Framebuffer {
   struct Attachement {
     GLuint id;
-    virtual bool isTexture() = 0;
-  };
-  struct TextureAttachement : public Attachement {
+    bool texture = true;
+    // generated by this framebuffer, so it is resized and deleted with it
     bool owned = false;
-    GLuint type;
-    virtual bool isTexture() { return true; }
-  };
-  struct RenderbufferAttachement : public Attachement {
-    virtual bool isTexture() { return false; }
+    GLenum internal = 0;
+    GLuint filter = GL_NEAREST;
   };
+  static const int granularity = 256;
   bool moved = false;
   int width = 0;
   int height = 0;
+  // size of the storage of the generated attachments
+  int allocWidth = 0;
+  int allocHeight = 0;
   GLuint id;
   void move(Framebuffer &foo) {
     foo.moved = true;
     id = foo.id;
     width = foo.width;
     height = foo.height;
+    allocWidth = foo.allocWidth;
+    allocHeight = foo.allocHeight;
     attachements = foo.attachements;
     targets = foo.targets;
-    oldviewp[0] = foo.oldviewp[0];
-    oldviewp[1] = foo.oldviewp[1];
-    oldviewp[2] = foo.oldviewp[2];
-    oldviewp[3] = foo.oldviewp[3];
+    oldviewp = foo.oldviewp;
     oldfbo = foo.oldfbo;
   }
   // to restore the viewport
-  GLint oldviewp[4];
-  GLint oldfbo;
+  glm::ivec4 oldviewp;
+  GLuint oldfbo;
   // attachements
   std::vector<GLenum> targets;
-  std::vector<Attachement *> attachements;
-  Attachement *depth = nullptr;
-  void deleteAttachement(Attachement *atch) {
-    if (atch->isTexture()) {
-      TextureAttachement *ta = (TextureAttachement *)atch;
-      if (ta->owned)
-        glDeleteTextures(1, &(ta->id));
-      delete ta;
-    } else {
-      RenderbufferAttachement *ra = (RenderbufferAttachement *)atch;
-      glDeleteRenderbuffers(1, &(ra->id));
-      delete ra;
+  std::vector<Attachement> attachements;
+  std::optional<Attachement> depth;
+  void deleteAttachement(const Attachement &atch) {
+    if (!atch.texture)
+      glDeleteRenderbuffers(1, &atch.id);
+    else if (atch.owned)
+      gl_state::delete_texture(atch.id);
+  }
+  /**
+   *  Rounds the size up to the granularity
+   */
+  static int bucket(int size) {
+    return std::max((size + granularity - 1) / granularity, 1) * granularity;
+  }
+  /**
+   *  Creates an immutable texture with the size of the storage
+   */
+  GLuint storeTexture(GLenum internal, GLuint filter) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    gl_state::bind_texture(GL_TEXTURE_2D, tex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, internal, allocWidth, allocHeight);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return tex;
+  }
+  /**
+   *  Binds the framebuffer for changing its attachments and returns the
+   * framebuffer bound before, which the caller binds again afterwards
+   */
+  GLuint edit() {
+    const GLuint bound = gl_state::framebuffer();
+    gl_state::bind_framebuffer(id);
+    return bound;
+  }
+  /**
+   *  Replaces the storage of the generated attachment with one of the current
+   * allocation size, textures get a new id
+   */
+  void reallocate(Attachement &atch, GLenum attachment) {
+    if (!atch.owned)
+      return;
+    if (!atch.texture) {
+      glBindRenderbuffer(GL_RENDERBUFFER, atch.id);
+      glRenderbufferStorage(GL_RENDERBUFFER, atch.internal, allocWidth,
+                            allocHeight);
+      glBindRenderbuffer(GL_RENDERBUFFER, 0);
+      return;
     }
+    gl_state::delete_texture(atch.id);
+    atch.id = storeTexture(atch.internal, atch.filter);
+    gl_state::bind_texture(GL_TEXTURE_2D, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, atch.id,
+                           0);
   }
 
 public:
@@ -62,17 +113,18 @@ public:
    *  Creates a new framebuffer with the given width and height and no
    * attachements
    */
-  Framebuffer(int _width, int _height) : width(_width), height(_height) {
+  Framebuffer(int _width, int _height)
+      : width(_width), height(_height), allocWidth(bucket(_width)),
+        allocHeight(bucket(_height)) {
     glGenFramebuffers(1, &id);
   }
   ~Framebuffer() {
     if (!moved) {
-      glDeleteFramebuffers(1, &id);
+      gl_state::delete_framebuffer(id);
       if (depth)
-        attachements.push_back(depth);
-      for (Attachement *atch : attachements) {
+        deleteAttachement(*depth);
+      for (const Attachement &atch : attachements)
         deleteAttachement(atch);
-      }
     }
   }
   Framebuffer(const Framebuffer &) = delete;
@@ -83,21 +135,21 @@ public:
     return *this;
   };
   /**
-   *  Binds the framebuffer and its attached buffers
+   *  Binds the framebuffer and its attached buffers. The previous state is
+   * taken from gl_state, so no state is queried.
    */
   void bind() {
-    glGetIntegerv(GL_VIEWPORT, oldviewp);
-    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldfbo);
-    glViewport(0, 0, width, height);
-    glBindFramebuffer(GL_FRAMEBUFFER, id);
-    glDrawBuffers(GLsizei(targets.size()), targets.data());
+    oldviewp = gl_state::viewport();
+    oldfbo = gl_state::framebuffer();
+    gl_state::set_viewport({0, 0, width, height});
+    gl_state::bind_framebuffer(id);
   }
   /**
    *  Restores the state from the beginning of the previous @code{bind()} call
    */
   void unbind() {
-    glBindFramebuffer(GL_FRAMEBUFFER, oldfbo);
-    glViewport(oldviewp[0], oldviewp[1], oldviewp[2], oldviewp[3]);
+    gl_state::bind_framebuffer(oldfbo);
+    gl_state::set_viewport(oldviewp);
   }
   /**
    *  Adds the given texture to this framebuffer as the depth attachement.
@@ -107,13 +159,12 @@ public:
    */
   void setDepthTexture(GLuint tex) {
     if (depth)
-      deleteAttachement(depth);
-    glBindFramebuffer(GL_FRAMEBUFFER, id);
-    depth = new TextureAttachement();
-    depth->id = tex;
+      deleteAttachement(*depth);
+    const GLuint bound = edit();
+    depth = Attachement{tex};
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
                            tex, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_state::bind_framebuffer(bound);
   }
   /**
    *  Generates a new texture with the width and height of the framebuffer
@@ -122,21 +173,9 @@ public:
    * deleted.
    */
   void generateDepthTexture(GLuint depthComp = GL_DEPTH_COMPONENT16) {
-    if (depth)
-      deleteAttachement(depth);
-    GLuint dt;
-    glGenTextures(1, &dt);
-    glBindTexture(GL_TEXTURE_2D, dt);
-    glTexImage2D(GL_TEXTURE_2D, 0, depthComp, width, height, 0,
-                 GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    setDepthTexture(dt);
-    TextureAttachement *pt = ((TextureAttachement *)depth);
-    pt->owned = true;
-    pt->type = depthComp;
+    setDepthTexture(storeTexture(depthComp, GL_NEAREST));
+    depth->owned = true;
+    depth->internal = depthComp;
   }
   /**
    * Generates a default Render Buffer and adds it to the depth attachement.
@@ -145,15 +184,16 @@ public:
    */
   void generateDepthBuffer(GLuint depthComp = GL_DEPTH_COMPONENT16) {
     if (depth)
-      deleteAttachement(depth);
+      deleteAttachement(*depth);
     GLuint rboDepthStencil;
     glGenRenderbuffers(1, &rboDepthStencil);
     glBindRenderbuffer(GL_RENDERBUFFER, rboDepthStencil);
-    glRenderbufferStorage(GL_RENDERBUFFER, depthComp, width, height);
+    glRenderbufferStorage(GL_RENDERBUFFER, depthComp, allocWidth, allocHeight);
+    const GLuint bound = edit();
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
                               GL_RENDERBUFFER, rboDepthStencil);
-    depth = new RenderbufferAttachement();
-    depth->id = rboDepthStencil;
+    gl_state::bind_framebuffer(bound);
+    depth = Attachement{rboDepthStencil, false, true, depthComp};
   }
   /**
    * Adds the given texture to this framebuffer as a new color attachement.
@@ -161,98 +201,79 @@ public:
    * are unknown.
    */
   void addColorTexture(GLuint tex) {
-    glBindFramebuffer(GL_FRAMEBUFFER, id);
+    const GLuint bound = edit();
     glFramebufferTexture2D(GL_FRAMEBUFFER,
                            GL_COLOR_ATTACHMENT0 + targets.size(), GL_TEXTURE_2D,
                            tex, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    TextureAttachement *foo = new TextureAttachement();
-    foo->id = tex;
-    attachements.push_back(foo);
+    attachements.push_back(Attachement{tex});
     targets.push_back(GL_COLOR_ATTACHMENT0 + targets.size());
+    // the draw buffers are state of the framebuffer, not set again by bind
+    glDrawBuffers(GLsizei(targets.size()), targets.data());
+    gl_state::bind_framebuffer(bound);
   }
   /**
    * Generates a texture and adds it to this framebuffer as a new color
    * attachement.
+   * @param internal a sized internal format, the storage is immutable
    */
-  void generateColorTexture(GLint internal = GL_RGB, GLint datatype = GL_FLOAT,
+  void generateColorTexture(GLint internal = GL_RGB8,
                             GLuint clamptype = GL_NEAREST) {
-    GLuint foo;
-    glGenTextures(1, &foo);
-    glBindTexture(GL_TEXTURE_2D, foo);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal, width, height, 0, GL_RGBA,
-                 datatype, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, clamptype);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, clamptype);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    addColorTexture(foo);
-    TextureAttachement *ptr =
-        (TextureAttachement *)attachements[attachements.size() - 1];
-    ptr->owned = true;
-    ptr->type = internal;
+    addColorTexture(storeTexture(internal, clamptype));
+    attachements.back().owned = true;
+    attachements.back().internal = internal;
+    attachements.back().filter = clamptype;
   }
   /**
-   *  Resizes this framebuffer and all added textures, that were created by this
-   * framebuffer. Consider: Not very fast.
+   *  Resizes this framebuffer. The generated attachments keep their storage
+   * (and texture ids) while the size fits into it and does not drop below
+   * half of it, otherwise they are reallocated in steps of granularity.
    */
   void resize(unsigned int width, unsigned int height) {
     this->width = width;
     this->height = height;
-    std::vector<Attachement *> atch(attachements.size() + 1);
-    for (Attachement *a : attachements) {
-      if (a) {
-        if (TextureAttachement *dta = dynamic_cast<TextureAttachement *>(a)) {
-          if (dta->owned) {
-            glBindTexture(GL_TEXTURE_2D, dta->id);
-            glTexImage2D(GL_TEXTURE_2D, 0, dta->type, width, height, 0, GL_RGBA,
-                         GL_FLOAT, nullptr);
-            glBindTexture(GL_TEXTURE_2D, 0);
-          }
-        }
-      }
-    }
-    if (depth) {
-      if (TextureAttachement *dta = dynamic_cast<TextureAttachement *>(depth)) {
-        if (dta->owned) {
-          glBindTexture(GL_TEXTURE_2D, dta->id);
-          glTexImage2D(GL_TEXTURE_2D, 0, dta->type, width, height, 0,
-                       GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
-          glBindTexture(GL_TEXTURE_2D, 0);
-        }
-      }
-    }
+    const int w = bucket(width), h = bucket(height);
+    if (w <= allocWidth && h <= allocHeight && 2 * w > allocWidth &&
+        2 * h > allocHeight)
+      return;
+    allocWidth = w;
+    allocHeight = h;
+    const GLuint bound = edit();
+    for (size_t i = 0; i < attachements.size(); i++)
+      reallocate(attachements[i], GL_COLOR_ATTACHMENT0 + i);
+    if (depth)
+      reallocate(*depth, GL_DEPTH_ATTACHMENT);
+    gl_state::bind_framebuffer(bound);
   }
   /**
-   *  Blits the contents of this Framebuffer to the specified Framebuffer
+   *  Blits the contents of this Framebuffer to the specified Framebuffer,
+   * which stays bound afterwards
    */
   void blit(GLuint fbo, unsigned int other_width, unsigned int other_height) {
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->id);
+    gl_state::bind_framebuffer(fbo);
+    gl_state::bind_read_framebuffer(this->id);
     glBlitFramebuffer(0, 0, width, height, 0, 0, other_width, other_height,
                       GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT |
                           GL_STENCIL_BUFFER_BIT,
                       GL_NEAREST);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl_state::bind_read_framebuffer(fbo);
   }
   /**
    *  Returns -1 if no depth attachement has been added or if the depth
    * attachement is a render buffer, else the OpenGL Texture handle.
    */
-  GLint getDepthTexture() {
-    return depth && depth->isTexture() ? depth->id : -1;
-  }
+  GLint getDepthTexture() { return depth && depth->texture ? depth->id : -1; }
   /**
    *  Returns -1 if no color attachement has been added to the n-th slot or if
    * the color attachement is a render buffer, else the OpenGL Texture handle.
    */
   GLint getColorTexture(int n = 0) {
-    return n < attachements.size() && attachements[n]->isTexture()
-               ? attachements[n]->id
+    return n < attachements.size() && attachements[n].texture
+               ? attachements[n].id
                : -1;
   }
   /**
-   *  Returns the current size of this framebuffer
+   *  Returns the current size of this framebuffer, the used part of its
+   * attachments
    */
   glm::ivec2 getSize() { return {width, height}; }
 };
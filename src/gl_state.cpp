@@ -0,0 +1,114 @@
+#include "gl_state.hpp"
+#include <map>
+#include <optional>
+// marks state that is not known, no valid name or enum has this value
+static const GLuint unknown = ~0u;
+static GLuint draw_fbo = unknown, read_fbo = unknown;
+static std::optional<glm::ivec4> current_viewport;
+static GLuint program = unknown, vertex_array = unknown;
+static GLenum culled = unknown;
+static GLuint active_unit = unknown;
+// bound texture by unit and target, missing entries are unknown
+static std::map<std::pair<GLuint, GLenum>, GLuint> textures;
+void gl_state::invalidate() {
+  draw_fbo = read_fbo = unknown;
+  current_viewport.reset();
+  program = vertex_array = culled = unknown;
+  forget_textures();
+}
+void gl_state::forget_textures() {
+  active_unit = unknown;
+  textures.clear();
+}
+GLuint gl_state::framebuffer() {
+  if (draw_fbo == unknown) {
+    GLint bound;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &bound);
+    draw_fbo = bound;
+  }
+  return draw_fbo;
+}
+void gl_state::bind_framebuffer(GLuint fbo) {
+  if (draw_fbo == fbo && read_fbo == fbo)
+    return;
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+  draw_fbo = read_fbo = fbo;
+}
+void gl_state::bind_read_framebuffer(GLuint fbo) {
+  if (read_fbo == fbo)
+    return;
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  read_fbo = fbo;
+}
+void gl_state::delete_framebuffer(GLuint fbo) {
+  glDeleteFramebuffers(1, &fbo);
+  if (draw_fbo == fbo)
+    draw_fbo = 0;
+  if (read_fbo == fbo)
+    read_fbo = 0;
+}
+glm::ivec4 gl_state::viewport() {
+  if (!current_viewport) {
+    GLint bound[4];
+    glGetIntegerv(GL_VIEWPORT, bound);
+    current_viewport = glm::ivec4(bound[0], bound[1], bound[2], bound[3]);
+  }
+  return *current_viewport;
+}
+void gl_state::set_viewport(glm::ivec4 viewport) {
+  if (current_viewport == viewport)
+    return;
+  glViewport(viewport.x, viewport.y, viewport.z, viewport.w);
+  current_viewport = viewport;
+}
+void gl_state::use_program(GLuint id) {
+  if (program == id)
+    return;
+  glUseProgram(id);
+  program = id;
+}
+void gl_state::bind_vertex_array(GLuint vao) {
+  if (vertex_array == vao)
+    return;
+  glBindVertexArray(vao);
+  vertex_array = vao;
+}
+void gl_state::delete_vertex_array(GLuint vao) {
+  glDeleteVertexArrays(1, &vao);
+  if (vertex_array == vao)
+    vertex_array = 0;
+}
+void gl_state::cull_face(GLenum face) {
+  if (culled == face)
+    return;
+  glCullFace(face);
+  culled = face;
+}
+void gl_state::bind_texture(GLuint unit, GLenum target, GLuint tex) {
+  auto bound = textures.find({unit, target});
+  if (bound != textures.end() && bound->second == tex)
+    return;
+  if (active_unit != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    active_unit = unit;
+  }
+  glBindTexture(target, tex);
+  textures[{unit, target}] = tex;
+}
+void gl_state::bind_texture(GLenum target, GLuint tex) {
+  if (active_unit != unknown) {
+    bind_texture(active_unit, target, tex);
+    return;
+  }
+  // the binding of the target is unknown for the unit that got it
+  glBindTexture(target, tex);
+  std::erase_if(textures, [target](const auto &bound) {
+    return bound.first.second == target;
+  });
+}
+void gl_state::delete_texture(GLuint tex) {
+  glDeleteTextures(1, &tex);
+  for (auto &bound : textures)
+    if (bound.second == tex)
+      bound.second = 0;
+}
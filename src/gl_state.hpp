@@ -0,0 +1,69 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+/**
+ *  Shadow of the GL state the renderer changes every frame: the bound
+ * framebuffers, the viewport, the program, the vertex array, the culled face
+ * and the textures of the units. Calls that would not change the state are
+ * not issued, and the previous state can be read without asking the driver
+ * (glGet* waits for it on multithreaded drivers).
+ *  Only valid for the context current on the render thread. State changed
+ * behind the tracker (by the toolkit, or by raw GL calls) has to be reported
+ * with invalidate or forget_textures. Unknown framebuffers and viewports are
+ * queried once when they are read, everything else unknown is just set.
+ */
+namespace gl_state {
+/**
+ *  Forgets all of the tracked state
+ */
+void invalidate();
+/**
+ *  Forgets the texture bindings and the active unit only, for toolkits that
+ * bind their own textures before each frame
+ */
+void forget_textures();
+/**
+ *  The framebuffer bound for drawing
+ */
+GLuint framebuffer();
+/**
+ *  Binds the framebuffer for drawing and reading
+ */
+void bind_framebuffer(GLuint fbo);
+/**
+ *  Binds the framebuffer for reading only (as the source of a blit)
+ */
+void bind_read_framebuffer(GLuint fbo);
+/**
+ *  Deletes the framebuffer, the bindings to it fall back to 0
+ */
+void delete_framebuffer(GLuint fbo);
+/**
+ *  The viewport as x, y, width and height
+ */
+glm::ivec4 viewport();
+void set_viewport(glm::ivec4 viewport);
+void use_program(GLuint program);
+void bind_vertex_array(GLuint vao);
+/**
+ *  Deletes the vertex array, the binding falls back to 0 if it was bound
+ */
+void delete_vertex_array(GLuint vao);
+void cull_face(GLenum face);
+/**
+ *  Binds the texture to the target of the unit, the unit becomes the active
+ * one
+ */
+void bind_texture(GLuint unit, GLenum target, GLuint tex);
+/**
+ *  Binds the texture to the target of the active unit, for creating and
+ * editing textures
+ */
+void bind_texture(GLenum target, GLuint tex);
+/**
+ *  Deletes the texture, the units it was bound to fall back to 0
+ */
+void delete_texture(GLuint tex);
+} // namespace gl_state
+#endif
@@ -0,0 +1,111 @@
+#include "headless.hpp"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glew.h>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+static bool has_extension(EGLDisplay disp, const char *name) {
+  const char *exts = eglQueryString(disp, EGL_EXTENSIONS);
+  return exts && strstr(exts, name);
+}
+bool headless::create_context() {
+  // prefer the surfaceless platform (works on render nodes and llvmpipe)
+  auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+      "eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay &&
+      has_extension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless"))
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                 EGL_DEFAULT_DISPLAY, nullptr);
+  if (display == EGL_NO_DISPLAY)
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+    std::cerr << "Could not initialize EGL display!" << std::endl;
+    return false;
+  }
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    std::cerr << "EGL does not support desktop OpenGL!" << std::endl;
+    return false;
+  }
+  const EGLint config_attribs[] = {EGL_SURFACE_TYPE,
+                                   EGL_PBUFFER_BIT,
+                                   EGL_RENDERABLE_TYPE,
+                                   EGL_OPENGL_BIT,
+                                   EGL_RED_SIZE,
+                                   8,
+                                   EGL_GREEN_SIZE,
+                                   8,
+                                   EGL_BLUE_SIZE,
+                                   8,
+                                   EGL_ALPHA_SIZE,
+                                   8,
+                                   EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) ||
+      num_configs == 0) {
+    std::cerr << "No suitable EGL config found!" << std::endl;
+    return false;
+  }
+  const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                    4,
+                                    EGL_CONTEXT_MINOR_VERSION,
+                                    3,
+                                    EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                    EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                    EGL_NONE};
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+  if (context == EGL_NO_CONTEXT) {
+    std::cerr << "Could not create an OpenGL 4.3 context!" << std::endl;
+    return false;
+  }
+  if (!has_extension(display, "EGL_KHR_surfaceless_context")) {
+    const EGLint pbuffer_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+  }
+  if (!eglMakeCurrent(display, surface, surface, context)) {
+    std::cerr << "Could not make the EGL context current!" << std::endl;
+    return false;
+  }
+  return true;
+}
+void headless::destroy_context() {
+  if (display == EGL_NO_DISPLAY)
+    return;
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (surface != EGL_NO_SURFACE)
+    eglDestroySurface(display, surface);
+  if (context != EGL_NO_CONTEXT)
+    eglDestroyContext(display, context);
+  eglTerminate(display);
+  display = EGL_NO_DISPLAY;
+  context = EGL_NO_CONTEXT;
+  surface = EGL_NO_SURFACE;
+}
+bool headless::write_frame(const std::string &path, int width, int height) {
+  std::vector<unsigned char> pixels(width * height * 3);
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+  std::ofstream file(path, std::ios::binary);
+  if (!file) {
+    std::cerr << "Could not write frame \"" << path << "\"" << std::endl;
+    return false;
+  }
+  file << "P6\n" << width << " " << height << "\n255\n";
+  // OpenGL rows start at the bottom, PPM rows at the top
+  for (int y = height - 1; y >= 0; y--)
+    file.write((const char *)&pixels[y * width * 3], width * 3);
+  return true;
+}
+int headless::internal_format(const std::string &name) {
+  static const std::unordered_map<std::string, int> formats = {
+      {"rgba32f", GL_RGBA32F}, {"rgba16f", GL_RGBA16F},
+      {"rgb10_a2", GL_RGB10_A2}, {"r32f", GL_R32F}, {"r16f", GL_R16F}};
+  auto format = formats.find(name);
+  return format == formats.end() ? 0 : format->second;
+}
@@ -0,0 +1,23 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+#include <string>
+namespace headless {
+/**
+ *  Creates an OpenGL 4.3 core context without a display (EGL surfaceless, or a
+ * 1x1 pbuffer if the driver does not support surfaceless contexts) and makes it
+ * current. Returns false if no context could be created.
+ */
+bool create_context();
+void destroy_context();
+/**
+ *  Reads the color attachement of the currently bound framebuffer and writes it
+ * as a binary PPM image to the given path.
+ */
+bool write_frame(const std::string &path, int width, int height);
+/**
+ *  The sized internal format of a name like "rgba32f", "rgb10_a2" or "r16f"
+ * (lowercase, without GL_), 0 if the name is unknown
+ */
+int internal_format(const std::string &name);
+} // namespace headless
+#endif
@@ -0,0 +1,119 @@
+#include "framebuffer.hpp"
+#include "headless.hpp"
+#include "renderer.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+static void usage(const char *name) {
+  std::cerr << "usage: " << name
+            << " [--width W] [--height H] [--frames N] [--output DIR]\n"
+               "       [--angle-x DEG] [--angle-y DEG] [--orbit DEG] "
+               "[--radius R] [--step-size S] [--adaptive-steps 0|1]\n"
+               "       [--noise-resolution N] [--noise-threads N] "
+               "[--resolution-divisor 1|2|4]\n"
+               "       [--temporal-subset 1|4|16] [--jitter 0|1] "
+               "[--single-pass 0|1] [--compute 0|1]\n"
+               "       [--shadow-steps N] "
+               "[--frontside-format rgba32f|rgba16f|rgb10_a2|r32f|r16f]"
+            << std::endl;
+}
+int main(int argc, char *argv[]) {
+  int width = 800, height = 600, frames = 1, noise_resolution = 128,
+      noise_threads = 0, adaptive_steps = 0, resolution_divisor = 1,
+      temporal_subset = 1, jitter = 0, single_pass = 1, compute = 0,
+      shadow_steps = 10;
+  std::string frontside_format = "rgba32f";
+  float angle_x = 0, angle_y = 60, orbit = 0, radius = 1.0, step_size = 0.02;
+  std::string output = "frames";
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    const char *val = argv[++i];
+    if (arg == "--width")
+      width = std::stoi(val);
+    else if (arg == "--height")
+      height = std::stoi(val);
+    else if (arg == "--frames")
+      frames = std::stoi(val);
+    else if (arg == "--output")
+      output = val;
+    else if (arg == "--angle-x")
+      angle_x = std::stof(val);
+    else if (arg == "--angle-y")
+      angle_y = std::stof(val);
+    else if (arg == "--orbit")
+      orbit = std::stof(val);
+    else if (arg == "--radius")
+      radius = std::stof(val);
+    else if (arg == "--step-size")
+      step_size = std::stof(val);
+    else if (arg == "--adaptive-steps")
+      adaptive_steps = std::stoi(val);
+    else if (arg == "--noise-resolution")
+      noise_resolution = std::stoi(val);
+    else if (arg == "--noise-threads")
+      noise_threads = std::stoi(val);
+    else if (arg == "--resolution-divisor")
+      resolution_divisor = std::stoi(val);
+    else if (arg == "--temporal-subset")
+      temporal_subset = std::stoi(val);
+    else if (arg == "--jitter")
+      jitter = std::stoi(val);
+    else if (arg == "--single-pass")
+      single_pass = std::stoi(val);
+    else if (arg == "--compute")
+      compute = std::stoi(val);
+    else if (arg == "--shadow-steps")
+      shadow_steps = std::stoi(val);
+    else if (arg == "--frontside-format")
+      frontside_format = val;
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  const int frontside_internal = headless::internal_format(frontside_format);
+  if (!frontside_internal) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (!headless::create_context())
+    return 1;
+  std::filesystem::create_directories(output);
+  cloud_renderer::set_adaptive_steps(adaptive_steps);
+  cloud_renderer::set_resolution_divisor(resolution_divisor);
+  cloud_renderer::set_temporal_subset(temporal_subset);
+  cloud_renderer::set_ray_jitter(jitter);
+  cloud_renderer::set_single_pass(single_pass);
+  cloud_renderer::set_compute_backend(compute);
+  cloud_renderer::set_shadow_steps(shadow_steps);
+  cloud_renderer::set_frontside_format(frontside_internal);
+  cloud_renderer::set_noise_resolution(noise_resolution);
+  cloud_renderer::set_noise_threads(noise_threads);
+  cloud_renderer::init();
+  cloud_renderer::resize(width, height);
+  cloud_renderer::set_view_angle_y(angle_y);
+  cloud_renderer::set_radius(radius);
+  cloud_renderer::set_step_size(step_size);
+  // stands in for the framebuffer GTK would provide
+  Framebuffer *target = new Framebuffer(width, height);
+  target->generateColorTexture(GL_RGBA8);
+  target->generateDepthBuffer();
+  char name[32];
+  for (int frame = 0; frame < frames; frame++) {
+    cloud_renderer::set_view_angle_x(angle_x + frame * orbit);
+    target->bind();
+    cloud_renderer::render();
+    snprintf(name, sizeof(name), "frame_%05d.ppm", frame);
+    headless::write_frame(output + "/" + name, width, height);
+    target->unbind();
+  }
+  delete target;
+  cloud_renderer::cleanup();
+  headless::destroy_context();
+  return 0;
+}
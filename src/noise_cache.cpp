@@ -0,0 +1,99 @@
+#include "noise_cache.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+static const char magic[8] = {'C', 'L', 'D', 'N', 'O', 'I', 'S', 'E'};
+static const uint32_t format_version = 1;
+static size_t texel_size(noise_cache::Format format) {
+  return format == noise_cache::Format::FLOAT32 ? sizeof(float) : 1;
+}
+std::string noise_cache::directory() {
+  if (const char *dir = getenv("CLOUDS_CACHE_DIR"))
+    return dir;
+  if (const char *xdg = getenv("XDG_CACHE_HOME"))
+    return std::string(xdg) + "/cloud-renderer";
+  if (const char *home = getenv("HOME"))
+    return std::string(home) + "/.cache/cloud-renderer";
+  return ".cache";
+}
+noise_cache::MappedEntry::~MappedEntry() { munmap(mapping, size); }
+uint64_t noise_cache::key(const std::string &description) {
+  // FNV-1a
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (unsigned char c : description) {
+    hash ^= c;
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+std::string noise_cache::path(uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.noise", (unsigned long long)key);
+  return directory() + "/" + name;
+}
+std::unique_ptr<noise_cache::MappedEntry> noise_cache::open(uint64_t key) {
+  const std::string file = path(key);
+  int fd = ::open(file.c_str(), O_RDONLY);
+  if (fd < 0)
+    return nullptr;
+  struct stat st;
+  if (fstat(fd, &st) || (size_t)st.st_size < sizeof(Header)) {
+    close(fd);
+    return nullptr;
+  }
+  void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return nullptr;
+  auto entry = std::make_unique<MappedEntry>(mapping, st.st_size);
+  const Header &h = entry->header();
+  const uint64_t expected = (uint64_t)h.width * h.height * h.depth *
+                            h.channels * texel_size(h.format);
+  if (memcmp(h.magic, magic, sizeof(magic)) || h.version != format_version ||
+      h.key != key || h.payload_size != expected ||
+      sizeof(Header) + h.payload_size > (size_t)st.st_size) {
+    std::cerr << "Ignoring invalid noise cache entry \"" << file << "\""
+              << std::endl;
+    return nullptr;
+  }
+  return entry;
+}
+bool noise_cache::store(uint64_t key, Format format, int width, int height,
+                        int depth, int channels, const void *payload) {
+  Header h;
+  memcpy(h.magic, magic, sizeof(magic));
+  h.version = format_version;
+  h.format = format;
+  h.key = key;
+  h.width = width;
+  h.height = height;
+  h.depth = depth;
+  h.channels = channels;
+  h.payload_size =
+      (uint64_t)width * height * depth * channels * texel_size(format);
+  const std::string file = path(key);
+  // unique per process, so concurrent writers never see partial files
+  const std::string tmp = file + "." + std::to_string(getpid()) + ".tmp";
+  std::error_code err;
+  std::filesystem::create_directories(directory(), err);
+  {
+    std::ofstream out(tmp, std::ios::binary);
+    out.write((const char *)&h, sizeof(h));
+    out.write((const char *)payload, h.payload_size);
+    if (!out) {
+      std::cerr << "Could not write noise cache entry \"" << file << "\""
+                << std::endl;
+      std::filesystem::remove(tmp, err);
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, file, err);
+  return !err;
+}
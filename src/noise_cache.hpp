@@ -0,0 +1,63 @@
+#ifndef NOISE_CACHE_HPP
+#define NOISE_CACHE_HPP
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+/**
+ *  Content addressed on-disk cache for generated noise textures. Each entry is
+ * a file named after the 64 bit hash of a description of the generator and its
+ * parameters, consisting of a fixed header directly followed by the raw texel
+ * payload, so a memory mapped entry can be handed to Texture::loadBinary /
+ * Texture::loadBinary3D without any parsing.
+ *  The directory is $CLOUDS_CACHE_DIR, else $XDG_CACHE_HOME/cloud-renderer,
+ * else ~/.cache/cloud-renderer.
+ */
+namespace noise_cache {
+enum class Format : uint32_t { FLOAT32 = 0, UINT8 = 1 };
+struct Header {
+  char magic[8];
+  uint32_t version;
+  Format format;
+  uint64_t key;
+  int32_t width, height, depth, channels;
+  uint64_t payload_size;
+};
+/**
+ *  Read only mapping of a cache entry, unmapped on destruction
+ */
+class MappedEntry {
+  void *mapping;
+  size_t size;
+
+public:
+  MappedEntry(void *mapping, size_t size) : mapping(mapping), size(size) {}
+  ~MappedEntry();
+  MappedEntry(const MappedEntry &) = delete;
+  MappedEntry &operator=(const MappedEntry &) = delete;
+  const Header &header() const { return *(const Header *)mapping; }
+  const void *payload() const {
+    return (const char *)mapping + sizeof(Header);
+  }
+};
+/**
+ *  Hash of a description of the generator and all of its parameters
+ */
+uint64_t key(const std::string &description);
+/**
+ *  The cache directory, also used by the program cache
+ */
+std::string directory();
+std::string path(uint64_t key);
+/**
+ *  Maps the entry of the key, nullptr if it does not exist or is invalid
+ */
+std::unique_ptr<MappedEntry> open(uint64_t key);
+/**
+ *  Writes an entry, the file appears atomically under its final name. Returns
+ * false if the cache is not writable.
+ */
+bool store(uint64_t key, Format format, int width, int height, int depth,
+           int channels, const void *payload);
+} // namespace noise_cache
+#endif
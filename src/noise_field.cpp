@@ -0,0 +1,42 @@
+#include "noise_field.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+static int thread_count = 0;
+static double generation_time = 0;
+void noise_field::set_threads(int threads) { thread_count = threads; }
+double noise_field::last_generation_time() { return generation_time; }
+std::vector<float> noise_field::generate(int width, int height, int depth,
+                                         int channels, const row_func &row) {
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<float> data((size_t)width * height * depth * channels);
+  const size_t tiles_x = (width + tile_size - 1) / tile_size;
+  const size_t tiles_y = (height + tile_size - 1) / tile_size;
+  const size_t tiles = tiles_x * tiles_y * depth;
+  std::atomic<size_t> next_tile = 0;
+  auto worker = [&]() {
+    for (size_t t; (t = next_tile++) < tiles;) {
+      const int x0 = (t % tiles_x) * tile_size;
+      const int y0 = ((t / tiles_x) % tiles_y) * tile_size;
+      const int z = t / (tiles_x * tiles_y);
+      const int n = std::min(tile_size, width - x0);
+      for (int y = y0; y < std::min(height, y0 + tile_size); y++)
+        row(x0, y, z, n,
+            &data[(((size_t)z * height + y) * width + x0) * channels]);
+    }
+  };
+  size_t threads =
+      thread_count > 0 ? thread_count : std::thread::hardware_concurrency();
+  threads = std::max<size_t>(1, std::min(threads, tiles));
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < threads; i++)
+    pool.emplace_back(worker);
+  worker();
+  for (std::thread &t : pool)
+    t.join();
+  generation_time = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  return data;
+}
@@ -0,0 +1,35 @@
+#ifndef NOISE_FIELD_HPP
+#define NOISE_FIELD_HPP
+#include <functional>
+#include <vector>
+namespace noise_field {
+/**
+ *  Edge length of the square tiles the grid is split into, also the maximum
+ * row length passed to a row function
+ */
+constexpr int tile_size = 64;
+/**
+ *  Fills out with channels * n interleaved values for the texels (x0, y, z) to
+ * (x0 + n - 1, y, z). Called concurrently from several threads.
+ */
+using row_func =
+    std::function<void(int x0, int y, int z, int n, float *out)>;
+/**
+ *  Number of threads used by generate, 0 (default) uses one per hardware
+ * thread.
+ */
+void set_threads(int threads);
+/**
+ *  Evaluates a width x height x depth grid with channels values per texel. The
+ * grid is split into tiles which are distributed dynamically across a pool of
+ * threads. Returns the values in x, y, z order with interleaved channels, as
+ * expected by Texture::loadBinary and Texture::loadBinary3D.
+ */
+std::vector<float> generate(int width, int height, int depth, int channels,
+                            const row_func &row);
+/**
+ *  Wall time of the last generate call in milliseconds
+ */
+double last_generation_time();
+} // namespace noise_field
+#endif
@@ -0,0 +1,131 @@
+#include "noise_volume.hpp"
+#include "noise_field.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+static inline int wrap(int i, int period) {
+  i %= period;
+  return i < 0 ? i + period : i;
+}
+// integer hash of a (wrapped) lattice point
+static inline uint32_t hash(int x, int y, int z, uint32_t seed) {
+  uint32_t h = seed * 0x9E3779B9u;
+  h ^= x * 0x8DA6B343u;
+  h = (h ^ (h >> 15)) * 0x2C1B3C6Du;
+  h ^= y * 0xD8163841u;
+  h = (h ^ (h >> 12)) * 0x297A2D39u;
+  h ^= z * 0xCB1AB31Fu;
+  h = (h ^ (h >> 15)) * 0x2C1B3C6Du;
+  return h ^ (h >> 16);
+}
+static inline float fade(float t) {
+  return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+static inline float lerp(float a, float b, float t) { return a + t * (b - a); }
+// dot product with one of the 12 edge gradients of the improved perlin noise
+static inline float grad(uint32_t hash, float x, float y, float z) {
+  const int h = hash % 12;
+  const float u = h < 8 ? x : y;
+  const float v = h < 4 ? y : h == 8 || h == 10 ? x : z;
+  return ((h & 1) ? -u : u) + ((h & 2) ? -v : v);
+}
+static inline float remap(float v, float lo, float hi, float new_lo,
+                          float new_hi) {
+  return new_lo + (v - lo) / (hi - lo) * (new_hi - new_lo);
+}
+float noise_volume::perlin(float x, float y, float z, int period,
+                           unsigned int seed) {
+  const int xi = (int)std::floor(x), yi = (int)std::floor(y),
+            zi = (int)std::floor(z);
+  const float xf = x - xi, yf = y - yi, zf = z - zi;
+  const int x0 = wrap(xi, period), x1 = wrap(xi + 1, period);
+  const int y0 = wrap(yi, period), y1 = wrap(yi + 1, period);
+  const int z0 = wrap(zi, period), z1 = wrap(zi + 1, period);
+  const float u = fade(xf), v = fade(yf), w = fade(zf);
+  const float n000 = grad(hash(x0, y0, z0, seed), xf, yf, zf);
+  const float n100 = grad(hash(x1, y0, z0, seed), xf - 1, yf, zf);
+  const float n010 = grad(hash(x0, y1, z0, seed), xf, yf - 1, zf);
+  const float n110 = grad(hash(x1, y1, z0, seed), xf - 1, yf - 1, zf);
+  const float n001 = grad(hash(x0, y0, z1, seed), xf, yf, zf - 1);
+  const float n101 = grad(hash(x1, y0, z1, seed), xf - 1, yf, zf - 1);
+  const float n011 = grad(hash(x0, y1, z1, seed), xf, yf - 1, zf - 1);
+  const float n111 = grad(hash(x1, y1, z1, seed), xf - 1, yf - 1, zf - 1);
+  return lerp(lerp(lerp(n000, n100, u), lerp(n010, n110, u), v),
+              lerp(lerp(n001, n101, u), lerp(n011, n111, u), v), w);
+}
+float noise_volume::worley(float x, float y, float z, int period,
+                           unsigned int seed) {
+  const int xi = (int)std::floor(x), yi = (int)std::floor(y),
+            zi = (int)std::floor(z);
+  float min_dist = 3.0f;
+  for (int dz = -1; dz <= 1; dz++)
+    for (int dy = -1; dy <= 1; dy++)
+      for (int dx = -1; dx <= 1; dx++) {
+        const int cx = xi + dx, cy = yi + dy, cz = zi + dz;
+        const uint32_t h = hash(wrap(cx, period), wrap(cy, period),
+                                wrap(cz, period), seed);
+        // feature point inside the (unwrapped) neighbour cell
+        const float fx = cx + (h & 0x3FF) / 1023.0f - x;
+        const float fy = cy + ((h >> 10) & 0x3FF) / 1023.0f - y;
+        const float fz = cz + ((h >> 20) & 0x3FF) / 1023.0f - z;
+        min_dist = std::min(min_dist, fx * fx + fy * fy + fz * fz);
+      }
+  return std::min(std::sqrt(min_dist), 1.0f);
+}
+// inverted worley fBm of three octaves in [0, 1]
+static float worley_fbm(float x, float y, float z, int period,
+                        unsigned int seed) {
+  using noise_volume::worley;
+  return 0.625f * (1.0f - worley(x, y, z, period, seed)) +
+         0.25f * (1.0f - worley(2 * x, 2 * y, 2 * z, 2 * period, seed + 1)) +
+         0.125f * (1.0f - worley(4 * x, 4 * y, 4 * z, 4 * period, seed + 2));
+}
+std::string noise_volume::description(const noise_volume::parameters &params,
+                                      const std::string &volume) {
+  return volume + " v" + std::to_string(version) +
+         " resolution=" + std::to_string(params.resolution) +
+         " detail_resolution=" + std::to_string(params.detail_resolution) +
+         " seed=" + std::to_string(params.seed) +
+         " octaves=" + std::to_string(params.octaves) +
+         " frequency=" + std::to_string(params.frequency);
+}
+std::vector<float>
+noise_volume::generate_shape(const noise_volume::parameters &params) {
+  const int res = params.resolution;
+  return noise_field::generate(
+      res, res, res, 1, [&params, res](int x0, int y, int z, int n, float *out) {
+        // texel centers in cells of the first octave
+        const float scale = (float)params.frequency / res;
+        for (int k = 0; k < n; k++) {
+          const float px = (x0 + k + 0.5f) * scale, py = (y + 0.5f) * scale,
+                      pz = (z + 0.5f) * scale;
+          float perlin_fbm = 0, amplitude = 1, denom = 0;
+          for (int o = 0; o < params.octaves; o++) {
+            const int f = 1 << o;
+            perlin_fbm += amplitude * perlin(px * f, py * f, pz * f,
+                                             params.frequency * f, params.seed);
+            denom += amplitude;
+            amplitude *= 0.5f;
+          }
+          perlin_fbm = 0.5f + 0.5f * perlin_fbm / denom;
+          const float cells =
+              worley_fbm(px, py, pz, params.frequency, params.seed + 16);
+          // billowy perlin-worley, the worley cells raise the lower bound
+          out[k] = std::clamp(remap(perlin_fbm, cells - 1.0f, 1.0f, 0.0f, 1.0f),
+                              0.0f, 1.0f);
+        }
+      });
+}
+std::vector<float>
+noise_volume::generate_detail(const noise_volume::parameters &params) {
+  const int res = params.detail_resolution;
+  const int frequency = params.frequency * 2;
+  return noise_field::generate(
+      res, res, res, 1,
+      [&params, res, frequency](int x0, int y, int z, int n, float *out) {
+        const float scale = (float)frequency / res;
+        for (int k = 0; k < n; k++)
+          out[k] = worley_fbm((x0 + k + 0.5f) * scale, (y + 0.5f) * scale,
+                              (z + 0.5f) * scale, frequency, params.seed + 32);
+      });
+}
@@ -0,0 +1,50 @@
+#ifndef NOISE_VOLUME_HPP
+#define NOISE_VOLUME_HPP
+#include <string>
+#include <vector>
+/**
+ *  Seamlessly tiling 3D noise volumes for the cloud density. The shape volume
+ * holds Perlin-Worley noise (gradient noise whose lower bound is remapped by
+ * inverted Worley fBm), the lower resolution detail volume Worley fBm of a
+ * higher frequency, used to erode the edges of the shapes. Both tile in all
+ * three dimensions, so they can be sampled with GL_REPEAT.
+ */
+namespace noise_volume {
+// has to be increased whenever the generated noise changes, invalidates caches
+constexpr int version = 1;
+struct parameters {
+  // edge length of the shape volume
+  int resolution = 128;
+  // edge length of the detail volume
+  int detail_resolution = 32;
+  unsigned int seed = 0;
+  // number of fBm octaves of the gradient noise
+  int octaves = 3;
+  // cells per tile of the first octave, has to be an integer to tile
+  int frequency = 4;
+};
+/**
+ *  Tiling gradient noise in [-1, 1] with a period of period cells along every
+ * axis
+ */
+float perlin(float x, float y, float z, int period, unsigned int seed);
+/**
+ *  Distance to the nearest feature point, one feature point per cell and a
+ * period of period cells along every axis. Result is clamped to [0, 1].
+ */
+float worley(float x, float y, float z, int period, unsigned int seed);
+/**
+ *  Unique description of the given volume ("shape" or "detail") generated with
+ * the parameters, e.g. as a cache key
+ */
+std::string description(const parameters &params, const std::string &volume);
+/**
+ *  resolution^3 single channel texels of Perlin-Worley noise in [0, 1]
+ */
+std::vector<float> generate_shape(const parameters &params);
+/**
+ *  detail_resolution^3 single channel texels of Worley fBm in [0, 1]
+ */
+std::vector<float> generate_detail(const parameters &params);
+} // namespace noise_volume
+#endif
@@ -0,0 +1,89 @@
+#include "program_cache.hpp"
+#include "noise_cache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unistd.h>
+static const char magic[8] = {'C', 'L', 'D', 'P', 'R', 'O', 'G', '\0'};
+static const uint32_t format_version = 1;
+struct Header {
+  char magic[8];
+  uint32_t version;
+  GLenum format;
+  uint64_t key;
+  uint64_t size;
+};
+static std::string entry_path(uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.program", (unsigned long long)key);
+  return noise_cache::directory() + "/" + name;
+}
+uint64_t program_cache::key(
+    const std::vector<std::pair<std::string, GLenum>> &sources) {
+  std::string description;
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const GLubyte *value = glGetString(name);
+    description += value ? (const char *)value : "";
+    description += '\n';
+  }
+  for (auto &source : sources)
+    description += std::to_string(source.second) + '\n' + source.first + '\0';
+  return noise_cache::key(description);
+}
+bool program_cache::load(uint64_t key, GLuint program) {
+  const std::string file = entry_path(key);
+  std::ifstream in(file, std::ios::binary);
+  if (!in)
+    return false;
+  Header h;
+  if (!in.read((char *)&h, sizeof(h)) ||
+      memcmp(h.magic, magic, sizeof(magic)) || h.version != format_version ||
+      h.key != key)
+    return false;
+  // the size of a damaged entry must not reach the allocation
+  std::error_code err;
+  const uintmax_t length = std::filesystem::file_size(file, err);
+  if (err || h.size != length - sizeof(h))
+    return false;
+  std::vector<char> binary(h.size);
+  if (!in.read(binary.data(), h.size))
+    return false;
+  glProgramBinary(program, h.format, binary.data(), GLsizei(h.size));
+  GLint success;
+  glGetProgramiv(program, GL_LINK_STATUS, &success);
+  return success;
+}
+bool program_cache::store(uint64_t key, GLuint program) {
+  GLint formats = 0, size = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+  if (!formats || !size)
+    return false;
+  std::vector<char> binary(size);
+  Header h;
+  memcpy(h.magic, magic, sizeof(magic));
+  h.version = format_version;
+  h.key = key;
+  glGetProgramBinary(program, size, nullptr, &h.format, binary.data());
+  h.size = size;
+  const std::string file = entry_path(key);
+  // unique per process, so concurrent writers never see partial files
+  const std::string tmp = file + "." + std::to_string(getpid()) + ".tmp";
+  std::error_code err;
+  std::filesystem::create_directories(noise_cache::directory(), err);
+  {
+    std::ofstream out(tmp, std::ios::binary);
+    out.write((const char *)&h, sizeof(h));
+    out.write(binary.data(), size);
+    if (!out) {
+      std::cerr << "Could not write program cache entry \"" << file << "\""
+                << std::endl;
+      std::filesystem::remove(tmp, err);
+      return false;
+    }
+  }
+  std::filesystem::rename(tmp, file, err);
+  return !err;
+}
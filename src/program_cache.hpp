@@ -0,0 +1,31 @@
+#ifndef PROGRAM_CACHE_HPP
+#define PROGRAM_CACHE_HPP
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+/**
+ *  On-disk cache of linked program binaries (glGetProgramBinary), next to the
+ * noise cache. An entry is keyed on the preprocessed source of every stage and
+ * the driver, so any change of a shader, an include, a define or the driver
+ * misses instead of loading a stale binary.
+ */
+namespace program_cache {
+/**
+ *  Hash of the preprocessed sources with their stage types and the vendor,
+ * renderer and version string of the current context
+ */
+uint64_t key(const std::vector<std::pair<std::string, GLenum>> &sources);
+/**
+ *  Loads the binary of the key into program, false if there is none or the
+ * driver rejects it (then program has to be compiled from source)
+ */
+bool load(uint64_t key, GLuint program);
+/**
+ *  Stores the binary of the linked program, false if the driver does not
+ * support program binaries or the cache is not writable
+ */
+bool store(uint64_t key, GLuint program);
+} // namespace program_cache
+#endif
@@ -1,15 +1,25 @@
 #include "renderer.hpp"
+#include "blue_noise.hpp"
 #include "framebuffer.hpp"
+#include "gl_state.hpp"
+#include "noise_cache.hpp"
+#include "noise_field.hpp"
+#include "noise_volume.hpp"
 #include "shader.hpp"
-#include "simplex.hpp"
+#include "shader_reload.hpp"
+#include "target_pool.hpp"
 #include "texture.hpp"
 #include "vao.hpp"
 #include <GL/gl.h>
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <functional>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include <gtkmm.h>
+#include <iostream>
 #include <random>
 static const float vertices[24]{-1.0f, -1.0f, -1.0f, 1.0f,  -1.0f, -1.0f,
                                 1.0f,  1.0f,  -1.0f, -1.0f, 1.0f,  -1.0f,
@@ -25,13 +35,98 @@ static void GLAPIENTRY messageCallback(GLenum source, GLenum type, GLuint id,
                                        const void *userParam) {
   std::cerr << std::string(message) << std::endl;
 }
-static GLuint noise2D;
-static glm::mat4 last_mat;
+static GLuint shape_noise, detail_noise;
+// coarse occupancy grid over the cloud box, cells of 0.125 units
+static GLuint occupancy;
+static const int occupancy_size[3] = {16, 16, 24}, occupancy_levels = 3;
+// transmittance towards the sun over the cloud box, recomputed whenever the
+// density or the lighting changes
+static GLuint light_volume;
+static ComputeShader *light_shader = nullptr;
+static ProgramVariants<ComputeShader> *light_variants = nullptr;
+static bool light_dirty = true;
+static const int light_size[3] = {64, 64, 96};
+// blue noise offsets of the ray starts, the offset of the frame is added to
+// it so that every pixel goes through all offsets
+static GLuint blue_noise_tex;
+static const int blue_noise_size = 64;
+static bool ray_jitter = false;
+static unsigned int jitter_frame = 0;
+static glm::mat4 last_mat, last_inv_mat;
 static glm::vec3 last_eye;
 static int last_width, last_height;
 static float angle_r = 1.0472, angle_p = 0, stepSize = 0.02, radius_scale = 1.0;
-static Framebuffer *back_side = nullptr;
+// the targets written and read within a frame: the front face positions of
+// the two pass mode, the reduced resolution and subset clouds and the target
+// of the compute backend
+static TargetPool *target_pool = nullptr;
+// computes the entry into the box analytically instead of rendering the front
+// faces first
+static bool single_pass = true;
+// format of the front face target of the two pass mode, which selects how the
+// positions are encoded (see frontside_encoding)
+static GLint frontside_format = GL_RGBA32F;
+// clouds marched at 1 / resolution_divisor of the resolution before they are
+// upsampled, only used with a divisor > 1
+static int resolution_divisor = 1;
+// temporal accumulation: a rotating subset of the pixels is marched into a
+// subset target and resolved together with the reprojected last frame into
+// the history target of the frame, only used with a subset > 1. The history
+// outlives the frame, so it is not pooled.
+static Framebuffer *history[2] = {nullptr, nullptr};
+static int temporal_subset = 1;
+static unsigned int subset_frame = 0;
+static bool history_valid = false;
+static glm::mat4 history_mat;
+static bool targets_dirty = true;
+// compute shader backend: 8x8 pixel tiles are classified, the ones with rays
+// through occupied cells are appended to a tile list (the indirect dispatch
+// arguments followed by the tiles) and marched into an RGBA8 target. The march
+// is split into dispatches of march_chunk samples per ray, each one lists the
+// tiles with rays that are not done for the next one (the two lists take
+// turns), so tiles that saturated early drop out. The last of the
+// march_dispatches marches the remaining rays to their end.
+static bool compute_backend = false;
+static ComputeShader *march_shader = nullptr;
+static ProgramVariants<ComputeShader> *march_variants = nullptr;
+static GLuint tile_buffers[2] = {0, 0};
+static int tile_capacity = 0;
+static const int tile_size = 8;
+static const int march_chunk = 64, march_dispatches = 3;
 static std::chrono::steady_clock::time_point start_point;
+/**
+ *  Parameters of the frame shared by all passes and both backends, std140
+ * layout of frame_params in shader/frame.glsl
+ */
+struct frame_params {
+  glm::mat4 cammat;
+  glm::mat4 inv_cammat;
+  glm::vec3 eye;
+  float stepSize;
+  glm::vec2 viewport;
+  float time;
+  float jitterOffset;
+  glm::ivec2 marchSize;
+};
+// the std140 block is 176 bytes, UniformBlock binds the rounded up size
+static_assert(sizeof(frame_params) == 168 &&
+                  offsetof(frame_params, eye) == 128 &&
+                  offsetof(frame_params, viewport) == 144 &&
+                  offsetof(frame_params, jitterOffset) == 156 &&
+                  offsetof(frame_params, marchSize) == 160,
+              "frame_params does not match the std140 member offsets");
+static UniformBlock<frame_params> *frame_block = nullptr;
+// settings compiled into the shaders, the variants are selected in render
+// once they changed
+static bool adaptive_steps = false;
+static int shadow_steps = 10;
+static bool variants_dirty = true;
+// rebuilds the programs whenever their sources change
+static bool hot_reload = false;
+static int noise_resolution = 128;
+static double noise_load_time = 0;
+static bool profiling = false;
+static GLuint timer_queries[2] = {0, 0};
 static void update_camera_matrix(int width, int height) {
   last_width = width;
   last_height = height;
@@ -44,17 +139,269 @@ static void update_camera_matrix(int width, int height) {
   mat4 proj =
       perspective(radians(50.f), (float)width / (float)height, 0.1f, 10.0f);
   last_mat = proj * view;
+  last_inv_mat = inverse(last_mat);
+}
+/**
+ *  Uploads a resolution^3 noise volume from the noise cache, on a miss it is
+ * generated and stored first
+ */
+static GLuint load_noise_volume(const std::string &description, int resolution,
+                                std::function<std::vector<float>()> generate) {
+  const uint64_t key = noise_cache::key(description);
+  if (auto entry = noise_cache::open(key)) {
+    const noise_cache::Header &h = entry->header();
+    if (h.format == noise_cache::Format::UINT8)
+      return Texture::loadBinary3D((unsigned char *)entry->payload(), h.width,
+                                   h.height, h.depth, h.channels);
+    return Texture::loadBinary3D((float *)entry->payload(), h.width, h.height,
+                                 h.depth, h.channels);
+  }
+  std::vector<float> data = generate();
+  noise_cache::store(key, noise_cache::Format::FLOAT32, resolution, resolution,
+                     resolution, 1, data.data());
+  return Texture::loadBinary3D(data.data(), resolution, resolution, resolution,
+                               1);
+}
+/**
+ *  Uploads the blue noise mask from the noise cache, on a miss it is generated
+ * and stored first
+ */
+static GLuint load_blue_noise() {
+  const uint64_t key =
+      noise_cache::key(blue_noise::description(blue_noise_size, 0));
+  if (auto entry = noise_cache::open(key)) {
+    const noise_cache::Header &h = entry->header();
+    // an entry of another shape is regenerated
+    if (h.format == noise_cache::Format::FLOAT32 &&
+        h.width == blue_noise_size && h.height == blue_noise_size &&
+        h.depth == 1 && h.channels == 1)
+      return Texture::loadBinary((float *)entry->payload(), h.width, h.height,
+                                 h.channels, GL_REPEAT, GL_NEAREST,
+                                 GL_NEAREST);
+  }
+  std::vector<float> data = blue_noise::generate(blue_noise_size, 0);
+  noise_cache::store(key, noise_cache::Format::FLOAT32, blue_noise_size,
+                     blue_noise_size, 1, 1, data.data());
+  return Texture::loadBinary(data.data(), blue_noise_size, blue_noise_size, 1,
+                             GL_REPEAT, GL_NEAREST, GL_NEAREST);
+}
+/**
+ *  Offset of the blue noise for the next frame, from the golden ratio sequence
+ * that is well distributed over any number of frames. In double, as a float
+ * product loses the fraction once the frame count grows.
+ */
+static float next_jitter_offset() {
+  return float(std::fmod(jitter_frame++ * 0.6180339887498949, 1.0));
+}
+/**
+ *  Builds the occupancy grid and its coarser levels from the noise volumes
+ */
+static GLuint build_occupancy_grid() {
+  GLuint tex;
+  glGenTextures(1, &tex);
+  gl_state::bind_texture(GL_TEXTURE_3D, tex);
+  glTexStorage3D(GL_TEXTURE_3D, occupancy_levels, GL_R8UI, occupancy_size[0],
+                 occupancy_size[1], occupancy_size[2]);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  ComputeShader builder("shader/occupancy_comp.glsl");
+  builder.start();
+  builder.loadTexture3D("shape_noise", shape_noise, 0);
+  for (int level = 0; level < occupancy_levels; level++) {
+    builder.load("level", level);
+    builder.bindImage(tex, GL_WRITE_ONLY, GL_R8UI, 0, level, true);
+    if (level > 0)
+      builder.bindImage(tex, GL_READ_ONLY, GL_R8UI, 1, level - 1, true);
+    builder.dispatch((occupancy_size[0] >> level) / 4 + 1,
+                     (occupancy_size[1] >> level) / 4 + 1,
+                     (occupancy_size[2] >> level) / 4 + 1);
+    builder.waitForBarriers();
+  }
+  builder.stop();
+  builder.cleanUp();
+  return tex;
+}
+static void update_light_volume() {
+  light_shader->start();
+  light_shader->load("stepSize", stepSize);
+  light_shader->loadTexture3D("shape_noise", shape_noise, 0);
+  light_shader->loadTexture3D("detail_noise", detail_noise, 1);
+  light_shader->load("jitter", ray_jitter ? 1 : 0);
+  light_shader->loadTexture("blue_noise", blue_noise_tex, 2);
+  light_shader->bindImage(light_volume, GL_WRITE_ONLY, GL_R16F, 0, 0, true);
+  light_shader->dispatch(light_size[0] / 4, light_size[1] / 4,
+                         light_size[2] / 4);
+  light_shader->stop();
+  light_dirty = false;
 }
 static Vao *render_box = nullptr;
 static ShaderProgram *program = nullptr;
-;
+static ProgramVariants<ShaderProgram> *program_variants = nullptr;
+// handles of the uniforms loaded every frame, named like in the shaders and
+// resolved whenever the variants are selected
+static struct {
+  ShaderProgram::Uniform backside, subsetTransform, resolutionDivisor,
+      subsetStride, subsetOffset, singlePass, prevmat, historyValid,
+      shape_noise, detail_noise, occupancy, light_volume, blue_noise,
+      frontside_tex, lowres_tex, subset_tex, subset_depth_tex, history_tex;
+} cloudbox;
+static struct {
+  ShaderProgram::Uniform stage, resume, sampleBudget, shape_noise,
+      detail_noise, occupancy, light_volume, blue_noise;
+} march;
+/**
+ *  Empties the tile list and binds it as the output list of the dispatches
+ */
+static void reset_tile_list(GLuint buffer) {
+  const GLuint reset[3] = {0, 1, 1};
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(reset), reset);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffer);
+}
+/**
+ *  Marches the clouds with the compute shader backend into a pooled target and
+ * blits it into the bound framebuffer. The first timer query covers the tile
+ * classification, the second the dispatches of the march.
+ */
+static bool render_compute() {
+  const GLuint fbo = gl_state::framebuffer();
+  reset_tile_list(tile_buffers[0]);
+  Framebuffer *compute_target =
+      target_pool->acquire({last_width, last_height}, {GL_RGBA8});
+  // the state of the rays between the dispatches of the march
+  Framebuffer *ray_state = target_pool->acquire({last_width, last_height},
+                                                {GL_RGBA32F, GL_RGBA32F});
+  march_shader->start();
+  march_shader->loadTexture3D(march.shape_noise, shape_noise, 1);
+  march_shader->loadTexture3D(march.detail_noise, detail_noise, 2);
+  march_shader->loadTexture3D(march.occupancy, occupancy, 3);
+  march_shader->loadTexture3D(march.light_volume, light_volume, 4);
+  march_shader->loadTexture(march.blue_noise, blue_noise_tex, 9);
+  march_shader->bindImage(compute_target->getColorTexture(), GL_WRITE_ONLY,
+                          GL_RGBA8, 0);
+  march_shader->bindImage(ray_state->getColorTexture(0), GL_READ_WRITE,
+                          GL_RGBA32F, 1);
+  march_shader->bindImage(ray_state->getColorTexture(1), GL_READ_WRITE,
+                          GL_RGBA32F, 2);
+  if (profiling)
+    glBeginQuery(GL_TIME_ELAPSED, timer_queries[0]);
+  march_shader->load(march.stage, 0);
+  march_shader->dispatch((last_width + tile_size - 1) / tile_size,
+                         (last_height + tile_size - 1) / tile_size);
+  // the tile lists are read as dispatch arguments and by the march, and
+  // emptied again once they were read
+  const GLbitfield list_barrier = GL_COMMAND_BARRIER_BIT |
+                                  GL_SHADER_STORAGE_BARRIER_BIT |
+                                  GL_BUFFER_UPDATE_BARRIER_BIT;
+  glMemoryBarrier(list_barrier);
+  if (profiling) {
+    glEndQuery(GL_TIME_ELAPSED);
+    glBeginQuery(GL_TIME_ELAPSED, timer_queries[1]);
+  }
+  march_shader->load(march.stage, 1);
+  for (int i = 0; i < march_dispatches; i++) {
+    const bool last = i == march_dispatches - 1;
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, tile_buffers[i % 2]);
+    reset_tile_list(tile_buffers[(i + 1) % 2]);
+    march_shader->load(march.resume, i > 0 ? 1 : 0);
+    march_shader->load(march.sampleBudget, last ? 0 : march_chunk);
+    march_shader->dispatchIndirect(tile_buffers[i % 2]);
+    if (!last)
+      glMemoryBarrier(list_barrier | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+  march_shader->stop();
+  if (profiling)
+    glEndQuery(GL_TIME_ELAPSED);
+  compute_target->blit(fbo, last_width, last_height);
+  target_pool->endFrame();
+  return true;
+}
+/**
+ *  Registers the program with the hot reload, if it is running
+ */
+template <typename Program> static Program *watched(Program *program) {
+  shader_reload::watch(program);
+  return program;
+}
+static void resolve_handles() {
+  cloudbox = {program->uniform("backside"),
+              program->uniform("subsetTransform"),
+              program->uniform("resolutionDivisor"),
+              program->uniform("subsetStride"),
+              program->uniform("subsetOffset"),
+              program->uniform("singlePass"),
+              program->uniform("prevmat"),
+              program->uniform("historyValid"),
+              program->uniform("shape_noise"),
+              program->uniform("detail_noise"),
+              program->uniform("occupancy"),
+              program->uniform("light_volume"),
+              program->uniform("blue_noise"),
+              program->uniform("frontside_tex"),
+              program->uniform("lowres_tex"),
+              program->uniform("subset_tex"),
+              program->uniform("subset_depth_tex"),
+              program->uniform("history_tex")};
+  march = {march_shader->uniform("stage"),
+           march_shader->uniform("resume"),
+           march_shader->uniform("sampleBudget"),
+           march_shader->uniform("shape_noise"),
+           march_shader->uniform("detail_noise"),
+           march_shader->uniform("occupancy"),
+           march_shader->uniform("light_volume"),
+           march_shader->uniform("blue_noise")};
+}
+/**
+ *  The define of the cloud box shader for the encoding of the front face
+ * positions in a target of the format: normalized box coordinates in 16 bit
+ * floats or 10 bit fixed point, the distance from the eye along the pixel ray
+ * in a single channel, or the positions themselves. Null for the positions.
+ */
+static const char *frontside_encoding(GLint format) {
+  switch (format) {
+  case GL_RGBA16F:
+  case GL_RGB10_A2:
+    return "FRONTSIDE_BOX";
+  case GL_R32F:
+  case GL_R16F:
+    return "FRONTSIDE_DEPTH";
+  }
+  return nullptr;
+}
+/**
+ *  Selects the variants of the programs matching the settings and resolves
+ * their uniform handles. The light volume only depends on the shadow steps.
+ */
+static void select_variants() {
+  const std::string shadow = "SHADOW_STEPS " + std::to_string(shadow_steps);
+  std::vector<std::string> defines = {shadow};
+  if (adaptive_steps)
+    defines.push_back("ADAPTIVE_STEPS");
+  march_shader = march_variants->get(defines);
+  if (const char *encoding = frontside_encoding(frontside_format))
+    defines.push_back(encoding);
+  program = program_variants->get(defines);
+  ComputeShader *light = light_variants->get({shadow});
+  light_dirty |= light != light_shader;
+  light_shader = light;
+  resolve_handles();
+  variants_dirty = false;
+}
 void cloud_renderer::init() {
   if (glewInit() != GLEW_OK) {
     std::cerr << "GLEW not initialized!" << std::endl;
   }
 
-  program = new ShaderProgram("shader/cloudbox_vert.glsl",
-                              "shader/cloudbox_frag.glsl", {"coords"});
+  if (hot_reload)
+    shader_reload::start();
+  program_variants = new ProgramVariants<ShaderProgram>(
+      [](const std::vector<std::string> &defines) {
+        return watched(new ShaderProgram("shader/cloudbox_vert.glsl",
+                                         "shader/cloudbox_frag.glsl",
+                                         {"coords"}, defines));
+      });
   render_box = new Vao();
   render_box->addVertexBuffer(3, &vertices[0], 72);
   render_box->addIndexBuffer(&indices[0], 36);
@@ -63,17 +410,46 @@ void cloud_renderer::init() {
   glEnable(GL_CULL_FACE);
   glEnable(GL_DEPTH_TEST);
   // Generate Noise
-  std::vector<float> nd2d(256 * 256 * 2);
-#pragma omp parallel for
-  for (int i = 0; i < 256; i++)
-    for (int j = 0; j < 256; j++) {
-
-      nd2d[i * 256 * 2 + j * 2] =
-          SimplexNoise::noise(i / 64.0, j / 64.0, (i + j) / 64.0);
-      nd2d[i * 256 * 2 + j * 2 + 1] =
-          SimplexNoise::noise(i / 64.0, j / 64.0, (j - i) / 64.0);
-    }
-  noise2D = Texture::loadBinary(nd2d.data(), 256, 256, 2);
+  const auto noise_start = std::chrono::steady_clock::now();
+  noise_volume::parameters params;
+  params.resolution = noise_resolution;
+  params.detail_resolution = std::max(noise_resolution / 4, 1);
+  shape_noise = load_noise_volume(
+      noise_volume::description(params, "shape"), params.resolution,
+      [&params]() { return noise_volume::generate_shape(params); });
+  detail_noise = load_noise_volume(
+      noise_volume::description(params, "detail"), params.detail_resolution,
+      [&params]() { return noise_volume::generate_detail(params); });
+  noise_load_time = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - noise_start)
+                        .count();
+  std::cerr << "Loaded " << params.resolution << "^3 shape and "
+            << params.detail_resolution << "^3 detail noise in "
+            << noise_load_time << " ms" << std::endl;
+  occupancy = build_occupancy_grid();
+  blue_noise_tex = load_blue_noise();
+  glGenTextures(1, &light_volume);
+  gl_state::bind_texture(GL_TEXTURE_3D, light_volume);
+  glTexStorage3D(GL_TEXTURE_3D, 1, GL_R16F, light_size[0], light_size[1],
+                 light_size[2]);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  light_variants = new ProgramVariants<ComputeShader>(
+      [](const std::vector<std::string> &defines) {
+        return watched(new ComputeShader("shader/light_comp.glsl", defines));
+      });
+  march_variants = new ProgramVariants<ComputeShader>(
+      [](const std::vector<std::string> &defines) {
+        return watched(
+            new ComputeShader("shader/raymarch_comp.glsl", defines));
+      });
+  select_variants();
+  light_dirty = true;
+  frame_block = new UniformBlock<frame_params>(0);
+  target_pool = new TargetPool();
   start_point = std::chrono::steady_clock::now();
 }
 void cloud_renderer::set_view_angle_y(float p) {
@@ -88,57 +464,311 @@ void cloud_renderer::set_radius(float r) {
   radius_scale = r;
   update_camera_matrix(last_width, last_height);
 }
-void cloud_renderer::set_step_size(float ss) { stepSize = ss; }
+void cloud_renderer::set_step_size(float ss) {
+  // the shadow rays of the light volume are scaled by the step size
+  light_dirty |= ss != stepSize;
+  history_valid &= ss == stepSize;
+  stepSize = ss;
+}
+void cloud_renderer::set_ray_jitter(bool enabled) {
+  light_dirty |= ray_jitter != enabled;
+  history_valid &= ray_jitter == enabled;
+  ray_jitter = enabled;
+}
+void cloud_renderer::set_adaptive_steps(bool enabled) {
+  history_valid &= adaptive_steps == enabled;
+  variants_dirty |= adaptive_steps != enabled;
+  adaptive_steps = enabled;
+}
+void cloud_renderer::set_shadow_steps(int steps) {
+  steps = std::max(steps, 1);
+  history_valid &= shadow_steps == steps;
+  variants_dirty |= shadow_steps != steps;
+  shadow_steps = steps;
+}
+void cloud_renderer::set_frontside_format(int internal) {
+  if (internal != GL_RGBA32F && !frontside_encoding(internal)) {
+    std::cerr << "Unsupported front face format 0x" << std::hex << internal
+              << std::dec << std::endl;
+    return;
+  }
+  history_valid &= frontside_format == internal;
+  variants_dirty |= frontside_format != internal;
+  frontside_format = internal;
+}
+void cloud_renderer::set_hot_reload(bool enabled) { hot_reload = enabled; }
+void cloud_renderer::set_noise_resolution(int resolution) {
+  noise_resolution = resolution;
+}
+void cloud_renderer::set_noise_threads(int threads) {
+  noise_field::set_threads(threads);
+}
+double cloud_renderer::last_noise_load_time() { return noise_load_time; }
+void cloud_renderer::set_profiling(bool enabled) {
+  if (enabled && !timer_queries[0])
+    glGenQueries(2, timer_queries);
+  profiling = enabled;
+}
+cloud_renderer::pass_timings cloud_renderer::last_pass_timings() {
+  GLuint64 elapsed[2];
+  for (int i = 0; i < 2; i++)
+    glGetQueryObjectui64v(timer_queries[i], GL_QUERY_RESULT, &elapsed[i]);
+  return {elapsed[0] / 1e6, elapsed[1] / 1e6};
+}
+static glm::ivec2 march_size(int width, int height) {
+  return {(width + resolution_divisor - 1) / resolution_divisor,
+          (height + resolution_divisor - 1) / resolution_divisor};
+}
+/**
+ *  Edge length of the pixel blocks of which one pixel is marched per frame
+ */
+static int subset_stride() { return temporal_subset >= 16 ? 4 : 2; }
+/**
+ *  Index of the pixel (x, y) of a size x size block in Bayer order
+ */
+static int bayer_index(int x, int y, int size) {
+  static const int bayer2[2][2] = {{0, 2}, {3, 1}};
+  if (size == 1)
+    return 0;
+  const int half = size / 2;
+  return 4 * bayer_index(x % half, y % half, half) + bayer2[y / half][x / half];
+}
+/**
+ *  Creates, resizes or deletes a history target so that it matches the size
+ * if it is needed
+ */
+static void fit_target(Framebuffer *&target, bool needed, glm::ivec2 size) {
+  if (!needed) {
+    delete target;
+    target = nullptr;
+  } else if (!target) {
+    target = new Framebuffer(size.x, size.y);
+    target->generateColorTexture(GL_RGBA16F);
+  } else if (target->getSize() != size)
+    target->resize(size.x, size.y);
+}
+/**
+ *  Grows the tile lists so that they hold every tile of the viewport
+ */
+static void fit_tile_buffers(int width, int height) {
+  const int tiles = ((width + tile_size - 1) / tile_size) *
+                    ((height + tile_size - 1) / tile_size);
+  if (tiles <= tile_capacity)
+    return;
+  if (!tile_buffers[0])
+    glGenBuffers(2, tile_buffers);
+  for (GLuint buffer : tile_buffers) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (3 + tiles) * sizeof(GLuint),
+                 nullptr, GL_DYNAMIC_DRAW);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  tile_capacity = tiles;
+}
 void cloud_renderer::resize(int width, int height) {
-  if (!back_side && program) {
-    back_side = new Framebuffer(width, height);
-    back_side->generateColorTexture(GL_RGBA32F);
-    back_side->generateDepthBuffer();
-  } else if (program)
-    back_side->resize(width, height);
+  if (program) {
+    const glm::ivec2 size = march_size(width, height);
+    // the history is not used by the compute backend
+    const bool temporal = temporal_subset > 1 && !compute_backend;
+    fit_target(history[0], temporal, size);
+    fit_target(history[1], temporal, size);
+    if (compute_backend)
+      fit_tile_buffers(width, height);
+    history_valid = false;
+    targets_dirty = false;
+  }
   update_camera_matrix(width, height);
 }
+void cloud_renderer::set_resolution_divisor(int divisor) {
+  resolution_divisor = std::max(divisor, 1);
+  targets_dirty = true;
+}
+void cloud_renderer::set_single_pass(bool enabled) {
+  single_pass = enabled;
+  targets_dirty = true;
+}
+void cloud_renderer::set_compute_backend(bool enabled) {
+  compute_backend = enabled;
+  targets_dirty = true;
+}
+void cloud_renderer::set_temporal_subset(int subset) {
+  temporal_subset = subset >= 16 ? 16 : subset >= 4 ? 4 : 1;
+  targets_dirty = true;
+}
 void cloud_renderer::cleanup() {
-  glDeleteTextures(1, &noise2D);
+  gl_state::delete_texture(shape_noise);
+  gl_state::delete_texture(detail_noise);
+  gl_state::delete_texture(occupancy);
+  gl_state::delete_texture(light_volume);
+  gl_state::delete_texture(blue_noise_tex);
+  shader_reload::stop();
+  light_variants->cleanUp();
+  delete light_variants;
+  march_variants->cleanUp();
+  delete march_variants;
+  light_variants = march_variants = nullptr;
+  light_shader = march_shader = nullptr;
+  glDeleteBuffers(2, tile_buffers);
+  tile_buffers[0] = tile_buffers[1] = 0;
+  tile_capacity = 0;
+  if (timer_queries[0])
+    glDeleteQueries(2, timer_queries);
+  timer_queries[0] = timer_queries[1] = 0;
+  profiling = false;
   delete render_box;
-  delete program;
-  if (back_side)
-    delete back_side;
+  render_box = nullptr;
+  program_variants->cleanUp();
+  delete program_variants;
+  program_variants = nullptr;
+  program = nullptr;
+  variants_dirty = true;
+  delete frame_block;
+  frame_block = nullptr;
+  delete target_pool;
+  target_pool = nullptr;
+  delete history[0];
+  delete history[1];
+  history[0] = history[1] = nullptr;
+  targets_dirty = true;
 }
-bool cloud_renderer::render(const Glib::RefPtr<Gdk::GLContext> &context) {
+bool cloud_renderer::render() {
   if (!render_box) {
     init();
   }
   glClearColor(0.2, 0.2, 0.5, 1.0);
   glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-  if (!back_side)
+  if (variants_dirty)
+    select_variants();
+  if (hot_reload && shader_reload::poll()) {
+    resolve_handles();
+    light_dirty = true;
+    history_valid = false;
+  }
+  if (targets_dirty)
     resize(last_width, last_height);
+  if (light_dirty)
+    update_light_volume();
+  frame_params params;
+  params.cammat = last_mat;
+  params.inv_cammat = last_inv_mat;
+  params.eye = last_eye;
+  params.stepSize = stepSize;
+  params.viewport = glm::vec2(last_width, last_height);
+  params.marchSize = march_size(last_width, last_height);
+  params.time = std::chrono::duration<float>(std::chrono::steady_clock::now() -
+                                             start_point)
+                    .count();
+  params.jitterOffset = ray_jitter ? next_jitter_offset() : -1.f;
+  frame_block->upload(params);
+  if (compute_backend)
+    return render_compute();
   program->start();
   render_box->bind();
-  program->load("cammat", last_mat);
-  program->load("eye", last_eye);
+  program->load(cloudbox.subsetTransform, glm::vec4(1, 1, 0, 0));
+  program->loadTexture3D(cloudbox.shape_noise, shape_noise, 1);
+  program->loadTexture3D(cloudbox.detail_noise, detail_noise, 2);
+  program->loadTexture3D(cloudbox.occupancy, occupancy, 3);
+  program->loadTexture3D(cloudbox.light_volume, light_volume, 4);
 
-  // backside
-  back_side->bind();
-  glClearColor(0, 0, 0, 0);
-  glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
-  glCullFace(GL_BACK);
-  program->load("backside", 0);
-  render_box->draw();
-  back_side->unbind();
+  // backside, the query stays empty in the single pass mode
+  if (profiling)
+    glBeginQuery(GL_TIME_ELAPSED, timer_queries[0]);
+  Framebuffer *back_side = nullptr;
+  if (!single_pass) {
+    back_side = target_pool->acquire({last_width, last_height},
+                                     {frontside_format}, GL_DEPTH_COMPONENT16);
+    back_side->bind();
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+    gl_state::cull_face(GL_BACK);
+    program->load(cloudbox.backside, 0);
+    render_box->draw();
+    back_side->unbind();
+  }
+  if (profiling) {
+    glEndQuery(GL_TIME_ELAPSED);
+    glBeginQuery(GL_TIME_ELAPSED, timer_queries[1]);
+  }
 
   // front side
-  glCullFace(GL_FRONT);
-  program->load("backside", 1);
-  program->load("stepSize", stepSize);
-  program->load(
-      "time", ((std::chrono::duration<float>)(std::chrono::steady_clock::now() -
-                                              start_point))
-                  .count());
-  program->loadTexture("frontside_tex", back_side->getColorTexture(), 0);
-  program->loadTexture("noise2D", noise2D, 1);
-  render_box->draw();
+  const bool temporal = temporal_subset > 1;
+  const bool reduced = resolution_divisor > 1 || temporal;
+  gl_state::cull_face(GL_FRONT);
+  program->load(cloudbox.resolutionDivisor, float(resolution_divisor));
+  program->load(cloudbox.subsetStride, 1);
+  program->load(cloudbox.subsetOffset, glm::ivec2(0));
+  program->load(cloudbox.singlePass, single_pass ? 1 : 0);
+  if (!single_pass)
+    program->loadTexture(cloudbox.frontside_tex, back_side->getColorTexture(),
+                         0);
+  program->loadTexture(cloudbox.blue_noise, blue_noise_tex, 9);
+  if (!reduced) {
+    program->load(cloudbox.backside, 1);
+    render_box->draw();
+  } else {
+    const int stride = temporal ? subset_stride() : 1;
+    const glm::ivec2 size = march_size(last_width, last_height);
+    // the subset target keeps the cloud depth for the reprojection
+    Framebuffer *clouds =
+        temporal ? target_pool->acquire((size + glm::ivec2(stride - 1)) / stride,
+                                        {GL_RGBA16F, GL_R32F})
+                 : target_pool->acquire(size, {GL_RGBA16F});
+    glm::ivec2 offset(0);
+    if (temporal) {
+      // next pixel of each stride x stride block in Bayer order
+      const int index = subset_frame++ % (stride * stride);
+      for (int y = 0; y < stride; y++)
+        for (int x = 0; x < stride; x++)
+          if (bayer_index(x, y, stride) == index)
+            offset = glm::ivec2(x, y);
+      // maps the center of the marched pixel of each block onto the center
+      // of its texel in the subset target
+      const glm::vec2 full(size);
+      const glm::vec2 sub = glm::vec2(clouds->getSize()) * float(stride);
+      const glm::vec2 scale = full / sub;
+      const glm::vec2 shift =
+          (full - 2.f * glm::vec2(offset) + float(stride - 1)) / sub - 1.f;
+      program->load(cloudbox.subsetTransform,
+                    glm::vec4(scale.x, scale.y, shift.x, shift.y));
+      program->load(cloudbox.subsetStride, stride);
+      program->load(cloudbox.subsetOffset, offset);
+    }
+    clouds->bind();
+    // a negative alpha marks texels not covered by the box for the upsampling
+    glClearColor(0, 0, 0, -1);
+    glClear(GL_COLOR_BUFFER_BIT);
+    program->load(cloudbox.backside, 2);
+    render_box->draw();
+    clouds->unbind();
+    if (temporal) {
+      Framebuffer *current = history[subset_frame % 2],
+                  *previous = history[(subset_frame + 1) % 2];
+      program->load(cloudbox.subsetTransform, glm::vec4(1, 1, 0, 0));
+      program->load(cloudbox.prevmat, history_mat);
+      program->load(cloudbox.historyValid, history_valid ? 1 : 0);
+      program->loadTexture(cloudbox.subset_tex, clouds->getColorTexture(), 6);
+      program->loadTexture(cloudbox.subset_depth_tex,
+                           clouds->getColorTexture(1), 8);
+      program->loadTexture(cloudbox.history_tex, previous->getColorTexture(),
+                           7);
+      current->bind();
+      glClear(GL_COLOR_BUFFER_BIT);
+      program->load(cloudbox.backside, 4);
+      render_box->draw();
+      current->unbind();
+      history_mat = last_mat;
+      history_valid = true;
+      target_pool->release(clouds);
+      clouds = current;
+    }
+    program->load(cloudbox.backside, 3);
+    program->loadTexture(cloudbox.lowres_tex, clouds->getColorTexture(), 5);
+    render_box->draw();
+  }
+  if (profiling)
+    glEndQuery(GL_TIME_ELAPSED);
   render_box->unbind();
   program->stop();
+  target_pool->endFrame();
   return true;
 }
@@ -1,14 +1,104 @@
 #ifndef RENDERER_HPP
 #define RENDERER_HPP
-#include <gtkmm.h>
 namespace cloud_renderer {
 void init();
 void cleanup();
-bool render(const Glib::RefPtr<Gdk::GLContext> &context);
+bool render();
 void resize(int width, int height);
 void set_view_angle_x(float r);
 void set_view_angle_y(float p);
 void set_step_size(float ss);
 void set_radius(float r);
+/**
+ *  Switches between the fixed step raymarcher and the adaptive one, whose
+ * step size (based on the step size setting) is coarse in empty space and
+ * grows with distance and accumulated opacity
+ */
+void set_adaptive_steps(bool enabled);
+/**
+ *  Number of samples of the shadow rays towards the sun (10 by default),
+ * compiled into the shaders so that a change builds new program variants
+ */
+void set_shadow_steps(int steps);
+/**
+ *  Computes where the rays enter the box analytically in the raymarching pass
+ * (the default) instead of rendering the front faces into a texture first.
+ * The two pass mode works for any convex proxy geometry.
+ */
+void set_single_pass(bool enabled);
+/**
+ *  Internal format of the front face target of the two pass mode, which
+ * selects how the positions are stored: GL_RGBA32F (the default) keeps them
+ * as they are, GL_RGBA16F and GL_RGB10_A2 normalize them to the box and
+ * GL_R32F and GL_R16F only keep their distance from the eye. The smaller
+ * formats cut the bandwidth of the pass at a small loss of precision.
+ */
+void set_frontside_format(int internal);
+/**
+ *  Marches the clouds with a compute shader in 8x8 pixel tiles instead of
+ * rasterizing the box. Tiles whose rays miss the box or only pass through
+ * empty space are written right away and skipped by the march. The march
+ * runs in dispatches of a bounded number of samples per ray, and only the
+ * tiles with rays that are not done yet are dispatched again, so tiles that
+ * saturate early stop taking up work groups. The resolution divisor and the
+ * temporal subset only apply to the fragment shader backend.
+ */
+void set_compute_backend(bool enabled);
+/**
+ *  Starts every ray a blue noise fraction of a step late, different in every
+ * frame, so larger step sizes produce noise instead of banding. The shadow
+ * rays of the light volume are offset as well.
+ */
+void set_ray_jitter(bool enabled);
+/**
+ *  Marches the clouds at 1 / divisor of the viewport resolution and upsamples
+ * them with the front face positions as guide, 1 marches every pixel
+ */
+void set_resolution_divisor(int divisor);
+/**
+ *  Marches only one of every 4 or 16 pixels per frame (in Bayer order) and
+ * fills the others with the reprojected clouds of the last frames, 1 marches
+ * every pixel
+ */
+void set_temporal_subset(int subset);
+/**
+ *  Edge length of the generated shape noise volume (the detail volume has a
+ * quarter of it), only has an effect before init
+ */
+void set_noise_resolution(int resolution);
+/**
+ *  Rebuilds the shaders in the background whenever their sources change and
+ * swaps them in once they linked, has to be set before init
+ */
+void set_hot_reload(bool enabled);
+/**
+ *  Number of threads for the noise generation, 0 uses all hardware threads
+ */
+void set_noise_threads(int threads);
+/**
+ *  Time init took to generate or load the noise volumes from the cache in
+ * milliseconds
+ */
+double last_noise_load_time();
+/**
+ *  GPU time of the two render passes of the last frame in milliseconds, the
+ * back-face pass is 0 in the single pass mode. The compute shader backend
+ * reports the tile classification as the back-face pass.
+ */
+struct pass_timings {
+  double backside;
+  double raymarch;
+};
+/**
+ *  Enables GL_TIME_ELAPSED queries around the back-face and the raymarching
+ * pass (including the upsampling of a reduced resolution march). Must be
+ * called with a current context.
+ */
+void set_profiling(bool enabled);
+/**
+ *  Waits for the queries of the last rendered frame, only valid if profiling
+ * is enabled.
+ */
+pass_timings last_pass_timings();
 } // namespace cloud_renderer
 #endif
@@ -2,81 +2,84 @@
 #include <glm/glm.hpp>
 #ifndef SHADER_HPP
 #define SHADER_HPP
+#include "gl_state.hpp"
+#include "program_cache.hpp"
+#include "shader_reload.hpp"
+#include "shader_source.hpp"
 #include <GL/glew.h>
+#include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <string>
-#include <sys/stat.h>
-#include <sys/types.h>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
-#ifndef WIN32
-#include <unistd.h>
-#else
-#define stat _stat
-#endif
-static long lastMod(std::string file) {
-  struct stat result;
-  if (!stat(file.c_str(), &result))
-    return result.st_mtime;
-  return -1;
+/**
+ *  Reads the file, resolves its #include "file" lines recursively and appends
+ * secondLine after the first line. Every file read is appended to files.
+ */
+static std::string loadFile(const std::string &path,
+                            const std::string &secondLine = "",
+                            std::vector<std::string> *files = nullptr) {
+  return shader_source::load(path, secondLine, files);
 }
-static std::string loadFile(std::string &path, std::string secondLine = "") {
-  using namespace std;
-  ifstream file(path);
-  string foo;
-  bool first = true;
-  for (string line; getline(file, line);) {
-    bool included_smt = false;
-    if (line[0] == '#') {
-      size_t i = 1;
-      const string includes = "include";
-      bool is_include = true;
-      for (; i < includes.size() + 1; i++)
-        if (line.size() <= i || line[i] != includes[i - 1]) {
-          is_include = false;
-          break;
-        }
-      if (is_include && line.size() > i + 2 && line[i++] == ' ' &&
-          line[i++] == '"') {
-        string infn = "";
-        for (; line.size() > i && line[i] != '"'; i++) {
-          infn += line[i];
-        }
-        foo.append(loadFile(infn));
-        foo.append("\n");
-        included_smt = true;
-      }
-    }
-    if (!included_smt) {
-      foo.append(line);
-      foo.append("\n");
-    }
-    if (first) {
-      foo.append(secondLine);
-      first = false;
-    }
+/**
+ *  Whether the current context supports the extension
+ */
+static bool hasExtension(const char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++)
+    if (!strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name))
+      return true;
+  return false;
+}
+/**
+ *  Prints the info log of the shader if it failed to compile
+ */
+static void checkShader(GLuint id) {
+  int success, length = 0;
+  glGetShaderiv(id, GL_COMPILE_STATUS, &success);
+  if (!success) {
+    glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+    std::string infoLog(std::max(length, 1), '\0');
+    glGetShaderInfoLog(id, length, nullptr, infoLog.data());
+    std::cerr << "Cloud not compile shader, log: "
+              << shader_source::annotate(infoLog.c_str()) << std::endl;
   }
-  file.close();
-  return foo;
 }
-static GLuint createShader(std::string file, GLuint type,
-                           std::string preproc = "") {
+/**
+ *  @param check waits for the compiler to report errors, otherwise they have
+ * to be checked with checkShader
+ */
+static GLuint compileShader(const std::string &source, GLuint type,
+                            bool check = true) {
   GLuint id = glCreateShader(type);
-  std::string srcs = loadFile(file, preproc);
-  const char *src = srcs.c_str();
+  const char *src = source.c_str();
   glShaderSource(id, 1, &src, nullptr);
   glCompileShader(id);
-  int success;
-  char infoLog[512];
-  glGetShaderiv(id, GL_COMPILE_STATUS, &success);
+  if (check)
+    checkShader(id);
+  return id;
+}
+/**
+ *  Prints the info log of the program and returns false if it failed to link
+ */
+static bool checkProgram(GLuint id) {
+  int success, length = 0;
+  glGetProgramiv(id, GL_LINK_STATUS, &success);
   if (!success) {
-    glGetShaderInfoLog(id, 512, nullptr, infoLog);
-    std::cerr << "Cloud not compile shader, log: " << std::string(infoLog)
+    glGetProgramiv(id, GL_INFO_LOG_LENGTH, &length);
+    std::string infoLog(std::max(length, 1), '\0');
+    glGetProgramInfoLog(id, length, nullptr, infoLog.data());
+    std::cerr << "Shader compilation failed, log: " << infoLog.c_str()
               << std::endl;
   }
-  return id;
+  return success;
 }
 class ShaderProgram {
 
@@ -84,36 +87,69 @@ protected:
   std::vector<std::string> attribs;
   std::unordered_map<std::string, GLint> uniformCache;
   uint activeTextures = 0;
+  std::vector<std::pair<std::string, GLuint>> stages;
+  std::vector<std::string> defines, files;
+  // program being rebuilt next to id, swapped in by finishRebuild
+  GLuint pending = 0;
+  std::vector<GLuint> pendingShaders;
+  uint64_t pendingKey = 0;
   void _construct(
       std::vector<std::pair<std::string, GLuint>> shader,
       std::vector<std::string> predefattribs = std::vector<std::string>(),
       std::vector<std::string> defines = std::vector<std::string>()) {
-    std::string preproc = "";
-    for (std::string def : defines)
-      preproc += "#define " + def + '\n';
+    stages = shader;
+    this->defines = defines;
+    files.clear();
+    // the binary cache is keyed on the sources after the includes and
+    // defines have been resolved
+    auto sources = preprocess(shader, defines, &files);
+    const uint64_t key = program_cache::key(sources);
     id = glCreateProgram();
-    std::vector<GLuint> todel(shader.size());
-    int i = 0;
-    for (auto &shd : shader) {
-      GLuint sid = createShader(shd.first, shd.second, preproc);
-      glAttachShader(id, sid);
-      todel[i++] = sid;
-    }
-    glLinkProgram(id);
-    for (GLuint del : todel)
-      glDeleteShader(del);
-    int success;
-    char infoLog[512];
-    glGetProgramiv(id, GL_LINK_STATUS, &success);
-    if (!success) {
-      glGetProgramInfoLog(id, 512, nullptr, infoLog);
-      std::cerr << "Shader compilation failed, log: " << std::string(infoLog)
-                << std::endl;
+    if (!program_cache::load(key, id)) {
+      std::vector<GLuint> todel;
+      for (auto &src : sources) {
+        GLuint sid = compileShader(src.first, src.second);
+        glAttachShader(id, sid);
+        todel.push_back(sid);
+      }
+      glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+      glLinkProgram(id);
+      for (GLuint del : todel)
+        glDeleteShader(del);
+      if (checkProgram(id))
+        program_cache::store(key, id);
     }
+    resolveUniforms();
     if (!predefattribs.empty())
       addAttributes(predefattribs);
   }
 
+  /**
+   *  Caches the locations of all active uniforms (arrays under their name
+   * with and without [0]), uniform block members have none
+   */
+  void resolveUniforms() {
+    uniformCache.clear();
+    GLint count = 0, max_length = 0;
+    glGetProgramInterfaceiv(id, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+    glGetProgramInterfaceiv(id, GL_UNIFORM, GL_MAX_NAME_LENGTH, &max_length);
+    std::vector<char> name(std::max(max_length, 1));
+    for (GLint i = 0; i < count; i++) {
+      glGetProgramResourceName(id, GL_UNIFORM, i, max_length, nullptr,
+                               name.data());
+      const GLenum property = GL_LOCATION;
+      GLint location;
+      glGetProgramResourceiv(id, GL_UNIFORM, i, 1, &property, 1, nullptr,
+                             &location);
+      if (location < 0)
+        continue;
+      std::string id(name.data());
+      uniformCache[id] = location;
+      if (id.size() > 3 && id.compare(id.size() - 3, 3, "[0]") == 0)
+        uniformCache[id.substr(0, id.size() - 3)] = location;
+    }
+  }
+
   ShaderProgram() {}
 
 public:
@@ -159,19 +195,147 @@ public:
    *  Does NOT happen in the destructor,
    *  so you can copy and move programs
    */
-  void cleanUp() { glDeleteProgram(id); }
+  void cleanUp() {
+    shader_reload::unwatch(this);
+    glDeleteProgram(id);
+    discardRebuild();
+  }
+  /**
+   *  Loads the sources of the stages and resolves their includes and defines.
+   * Does not touch GL, so it can run on any thread.
+   *  @param files if not null, every file read is appended to it
+   */
+  static std::vector<std::pair<std::string, GLenum>>
+  preprocess(std::vector<std::pair<std::string, GLuint>> stages,
+             const std::vector<std::string> &defines,
+             std::vector<std::string> *files = nullptr) {
+    std::string preproc = "";
+    for (const std::string &def : defines)
+      preproc += "#define " + def + '\n';
+    std::vector<std::pair<std::string, GLenum>> sources;
+    for (auto &stage : stages)
+      sources.push_back({loadFile(stage.first, preproc, files), stage.second});
+    return sources;
+  }
+  /**
+   *  The paths of the shader stages and their types
+   */
+  const std::vector<std::pair<std::string, GLuint>> &getStages() const {
+    return stages;
+  }
+  const std::vector<std::string> &getDefines() const { return defines; }
+  /**
+   *  Every file the program was built from, includes as well
+   */
+  const std::vector<std::string> &getFiles() const { return files; }
+  const std::vector<std::string> &getAttributes() const { return attribs; }
+  /**
+   *  Issues the compilation and the link of the sources into a new program
+   * without waiting for the driver, which can compile on its own threads with
+   * GL_KHR_parallel_shader_compile.
+   *  @param shaders receives the shader objects, to be checked with
+   * checkShader and deleted once the link finished
+   */
+  static GLuint
+  startLink(const std::vector<std::pair<std::string, GLenum>> &sources,
+            const std::vector<std::string> &attribs,
+            std::vector<GLuint> &shaders) {
+    GLuint id = glCreateProgram();
+    for (auto &src : sources) {
+      GLuint sid = compileShader(src.first, src.second, false);
+      glAttachShader(id, sid);
+      shaders.push_back(sid);
+    }
+    for (size_t i = 0; i < attribs.size(); i++)
+      glBindAttribLocation(id, i, attribs[i].c_str());
+    glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(id);
+    return id;
+  }
+  /**
+   *  Starts rebuilding the program from the sources (from preprocess) next
+   * to the current one, a rebuild still in flight is discarded
+   *  @param files the files the sources were read from
+   */
+  void rebuild(const std::vector<std::pair<std::string, GLenum>> &sources,
+               const std::vector<std::string> &files) {
+    discardRebuild();
+    this->files = files;
+    pendingKey = program_cache::key(sources);
+    pending = startLink(sources, attribs, pendingShaders);
+  }
+  /**
+   *  Takes a program rebuilt on a shared context as the rebuild in flight
+   *  @param linked the finished startLink of the sources with the key
+   * program_cache::key
+   */
+  void adoptRebuild(GLuint linked, uint64_t key,
+                    const std::vector<std::string> &files) {
+    discardRebuild();
+    this->files = files;
+    pendingKey = key;
+    pending = linked;
+  }
+  /**
+   *  Checks on the rebuild, once the driver finished it the new program
+   * replaces the current one if it linked and is dropped otherwise. Without
+   * parallel shader compile support this waits for the driver.
+   *  @return true if the program was replaced, the handles returned by uniform
+   * have to be resolved again
+   */
+  bool finishRebuild() {
+    if (!pending)
+      return false;
+    static const bool parallel =
+        hasExtension("GL_KHR_parallel_shader_compile") ||
+        hasExtension("GL_ARB_parallel_shader_compile");
+    if (parallel) {
+      GLint done = GL_FALSE;
+      glGetProgramiv(pending, GL_COMPLETION_STATUS_KHR, &done);
+      if (!done)
+        return false;
+    }
+    for (GLuint sid : pendingShaders)
+      checkShader(sid);
+    if (!checkProgram(pending)) {
+      discardRebuild();
+      return false;
+    }
+    program_cache::store(pendingKey, pending);
+    glDeleteProgram(id);
+    id = pending;
+    pending = 0;
+    discardRebuild();
+    resolveUniforms();
+    return true;
+  }
+  /**
+   *  Whether a rebuild is in flight
+   */
+  bool rebuilding() const { return pending != 0; }
+  /**
+   *  Drops the rebuild in flight, if any
+   */
+  void discardRebuild() {
+    for (GLuint sid : pendingShaders)
+      glDeleteShader(sid);
+    pendingShaders.clear();
+    if (pending)
+      glDeleteProgram(pending);
+    pending = 0;
+  }
   /**
    *  Tells OpenGL to draw the following draw calls
    *  with this program
    */
   void start() {
-    glUseProgram(id);
+    gl_state::use_program(id);
     activeTextures = 0;
   }
   /**
    *  Not necessary
    */
-  virtual void stop() const { glUseProgram(0); }
+  virtual void stop() const { gl_state::use_program(0); }
   /**
    *  Constructs a standard shader program consisting of vertex shader and
    * fragment shader.
@@ -183,302 +347,268 @@ public:
     _construct({{vertex, GL_VERTEX_SHADER}, {fragment, GL_FRAGMENT_SHADER}},
                predefattribs, defines);
   }
+  /**
+   *  Handle of a uniform variable, resolving the name once with uniform() lets
+   * the loads below skip the lookup. -1 (inactive uniforms) is ignored by GL.
+   */
+  struct Uniform {
+    GLint location = -1;
+  };
+  /**
+   *  Returns the handle of the uniform variable, all active uniforms are
+   * resolved when the program is linked
+   * @param id the identifier of that uniform variable
+   */
+  Uniform uniform(const std::string &id) const {
+    auto it = uniformCache.find(id);
+    return it == uniformCache.end() ? Uniform() : Uniform{it->second};
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, float value) { glUniform1f(u.location, value); }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, float value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniform1f(i, value);
+  void load(const std::string &id, float value) { load(uniform(id), value); }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::vec2 &value) {
+    glUniform2f(u.location, value.x, value.y);
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::vec2 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniform2f(i, value.x, value.y);
+  void load(const std::string &id, const glm::vec2 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::vec3 &value) {
+    glUniform3f(u.location, value.x, value.y, value.z);
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::vec3 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniform3f(i, value.x, value.y, value.z);
+  void load(const std::string &id, const glm::vec3 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::vec4 &value) {
+    glUniform4f(u.location, value.x, value.y, value.z, value.w);
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::vec4 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniform4f(i, value.x, value.y, value.z, value.w);
+  void load(const std::string &id, const glm::vec4 &value) {
+    load(uniform(id), value);
   }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, int value) { glUniform1i(u.location, value); }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, int value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniform1i(i, value);
+  void load(const std::string &id, int value) { load(uniform(id), value); }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::ivec2 &value) {
+    glUniform2i(u.location, value.x, value.y);
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::ivec2 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniform2i(i, value.x, value.y);
+  void load(const std::string &id, const glm::ivec2 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::ivec3 &value) {
+    glUniform3i(u.location, value.x, value.y, value.z);
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::ivec3 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniform3i(i, value.x, value.y, value.z);
+  void load(const std::string &id, const glm::ivec3 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::ivec4 &value) {
+    glUniform4i(u.location, value.x, value.y, value.z, value.w);
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::ivec4 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniform4i(i, value.x, value.y, value.z, value.w);
+  void load(const std::string &id, const glm::ivec4 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat2 &value) {
+    glUniformMatrix2fv(u.location, 1, false, &(value[0][0]));
   }
-
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat2 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix2fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat2 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat3 &value) {
+    glUniformMatrix3fv(u.location, 1, false, &(value[0][0]));
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat3 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix3fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat3 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat4 &value) {
+    glUniformMatrix4fv(u.location, 1, false, &(value[0][0]));
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat4 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix4fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat4 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat2x3 &value) {
+    glUniformMatrix2x3fv(u.location, 1, false, &(value[0][0]));
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat2x3 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix2x3fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat2x3 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat2x4 &value) {
+    glUniformMatrix2x4fv(u.location, 1, false, &(value[0][0]));
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat2x4 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix2x4fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat2x4 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat3x2 &value) {
+    glUniformMatrix3x2fv(u.location, 1, false, &(value[0][0]));
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat3x2 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix3x2fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat3x2 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat3x4 &value) {
+    glUniformMatrix3x4fv(u.location, 1, false, &(value[0][0]));
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat3x4 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix3x4fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat3x4 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat4x2 &value) {
+    glUniformMatrix4x2fv(u.location, 1, false, &(value[0][0]));
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat4x2 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix4x2fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat4x2 &value) {
+    load(uniform(id), value);
+  }
+  /**
+   *  Loads a value to a uniform variable
+   * @param u the handle of that uniform variable
+   */
+  void load(Uniform u, const glm::mat4x3 &value) {
+    glUniformMatrix4x3fv(u.location, 1, false, &(value[0][0]));
   }
   /**
    *  Loads a value to a uniform variable
    * @param id the identifier of that uniform variable
    */
-  void load(std::string id, glm::mat4x3 value) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    glUniformMatrix4x3fv(i, 1, false, &(value[0][0]));
+  void load(const std::string &id, const glm::mat4x3 &value) {
+    load(uniform(id), value);
   }
   /**
    * Loads an image to a uniform variable. The image is automatically bound.
-   * @param id the identifier of that uniform variable
+   * @param u the handle of that uniform variable
    * @param tex the opengl id for the texture
    * @param unit the texture socket this texture should be loaded to. Will be
    * automatically assigned if -1.
    */
-  void loadTexture(std::string id, GLuint tex, int unit = -1) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
+  void loadTexture(Uniform u, GLuint tex, int unit = -1,
+                   GLenum target = GL_TEXTURE_2D) {
+    if (u.location == -1)
+      return;
     if (unit < 0)
       unit = activeTextures;
     activeTextures++;
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glUniform1i(i, unit);
+    gl_state::bind_texture(unit, target, tex);
+    glUniform1i(u.location, unit);
   }
   /**
    * Loads an image to a uniform variable. The image is automatically bound.
@@ -487,22 +617,28 @@ public:
    * @param unit the texture socket this texture should be loaded to. Will be
    * automatically assigned if -1.
    */
-  void loadTexture3D(std::string id, GLuint tex, int unit = -1) {
-    GLint i;
-    if (uniformCache.find(id) == uniformCache.end()) {
-      uniformCache.insert({id, glGetUniformLocation(this->id, id.c_str())});
-      i = uniformCache[id];
-      if (i == -1) {
-        return;
-      }
-    } else
-      i = uniformCache[id];
-    if (unit < 0)
-      unit = activeTextures;
-    activeTextures++;
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_3D, tex);
-    glUniform1i(i, unit);
+  void loadTexture(const std::string &id, GLuint tex, int unit = -1) {
+    loadTexture(uniform(id), tex, unit);
+  }
+  /**
+   * Loads a 3D image to a uniform variable. The image is automatically bound.
+   * @param u the handle of that uniform variable
+   * @param tex the opengl id for the texture
+   * @param unit the texture socket this texture should be loaded to. Will be
+   * automatically assigned if -1.
+   */
+  void loadTexture3D(Uniform u, GLuint tex, int unit = -1) {
+    loadTexture(u, tex, unit, GL_TEXTURE_3D);
+  }
+  /**
+   * Loads a 3D image to a uniform variable. The image is automatically bound.
+   * @param id the identifier of that uniform variable
+   * @param tex the opengl id for the texture
+   * @param unit the texture socket this texture should be loaded to. Will be
+   * automatically assigned if -1.
+   */
+  void loadTexture3D(const std::string &id, GLuint tex, int unit = -1) {
+    loadTexture(uniform(id), tex, unit, GL_TEXTURE_3D);
   }
 };
 class ComputeShader : public ShaderProgram {
@@ -520,25 +656,149 @@ public:
     glDispatchCompute(workGroupX, workGroupY, workGroupZ);
     drawingTextures = 0;
   }
+  /**
+   *  Dispatches the number of work groups stored as three GLuints at offset
+   * of the buffer
+   */
+  void dispatchIndirect(GLuint buffer, GLintptr offset = 0) {
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer);
+    glDispatchComputeIndirect(offset);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    drawingTextures = 0;
+  }
   void waitForBarriers() const { glMemoryBarrier(GL_ALL_BARRIER_BITS); }
   /**
    *  Waits for all memory barriers and unbinds this shader
    */
   virtual void stop() const {
     waitForBarriers();
-    glUseProgram(0);
+    gl_state::use_program(0);
   }
   /**
    *  Binds the texture to the n-th image unit
    *  Can be called multiple times. The first bound texture per iteration will
    * be bound to 0, the second to 1, ....
+   *  Layered textures (3D, arrays) are bound with all of their layers.
    */
   void bindImage(GLuint tex, GLenum access = GL_READ_WRITE,
-                 GLenum format = GL_RGBA32F, int unit = -1) {
+                 GLenum format = GL_RGBA32F, int unit = -1, int level = 0,
+                 bool layered = false) {
     if (unit < 0)
       unit = drawingTextures;
     drawingTextures = unit + 1;
-    glBindImageTexture(unit, tex, 0, GL_FALSE, 0, access, format);
+    glBindImageTexture(unit, tex, level, layered ? GL_TRUE : GL_FALSE, 0,
+                       access, format);
+  }
+};
+/**
+ *  Permutations of one program specialized by sets of defines (like
+ * "SHADOW_STEPS 10"), so that settings fixed over many frames become
+ * compile-time constants instead of uniforms branched on per sample.
+ *  Every variant is built on the first get of its defines and kept until
+ * cleanUp, switching back to it costs a map lookup.
+ */
+template <typename Program> class ProgramVariants {
+  std::function<Program *(const std::vector<std::string> &)> build;
+  std::map<std::vector<std::string>, Program *> variants;
+
+public:
+  /**
+   *  @param build constructs the program with the passed defines
+   */
+  ProgramVariants(
+      std::function<Program *(const std::vector<std::string> &)> build)
+      : build(build) {}
+  ProgramVariants(const ProgramVariants &) = delete;
+  ProgramVariants &operator=(const ProgramVariants &) = delete;
+  /**
+   *  Returns the variant with the defines, independent of their order
+   */
+  Program *get(std::vector<std::string> defines) {
+    std::sort(defines.begin(), defines.end());
+    auto variant = variants.find(defines);
+    if (variant != variants.end())
+      return variant->second;
+    return variants[defines] = build(defines);
+  }
+  /**
+   *  Deletes all variants built so far
+   */
+  void cleanUp() {
+    for (auto &variant : variants) {
+      variant.second->cleanUp();
+      delete variant.second;
+    }
+    variants.clear();
+  }
+};
+/**
+ *  A uniform buffer holding one T, which has to match the std140 layout of the
+ * uniform block it is bound to (vec3s followed by a scalar, no bools). std140
+ * rounds the size of the block up to a multiple of 16 bytes, the bound range
+ * is rounded the same way even if T does not end with that padding.
+ *  The buffer is persistently mapped and split into three copies, upload writes
+ * the next one and binds it, so the GPU can still read the copies of the
+ * previous frames. Every upload costs one memcpy and one glBindBufferRange.
+ */
+template <typename T> class UniformBlock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "uniform blocks are uploaded with memcpy");
+  static const int copies = 3;
+  GLuint id = 0, binding;
+  // the std140 size of the block and the distance between the copies
+  GLsizeiptr size, stride;
+  char *mapped = nullptr;
+  GLsync fences[copies] = {nullptr, nullptr, nullptr};
+  int current = copies - 1;
+
+public:
+  /**
+   *  @param binding the uniform buffer binding point, which is set in the
+   * shader with layout(std140, binding = ...)
+   */
+  UniformBlock(GLuint binding) : binding(binding) {
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    size = (sizeof(T) + 15) & ~GLsizeiptr(15);
+    stride = (size + alignment - 1) / alignment * alignment;
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &id);
+    glBindBuffer(GL_UNIFORM_BUFFER, id);
+    glBufferStorage(GL_UNIFORM_BUFFER, stride * copies, nullptr, flags);
+    mapped = (char *)glMapBufferRange(GL_UNIFORM_BUFFER, 0, stride * copies,
+                                      flags);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  }
+  ~UniformBlock() {
+    for (GLsync fence : fences)
+      if (fence)
+        glDeleteSync(fence);
+    glBindBuffer(GL_UNIFORM_BUFFER, id);
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glDeleteBuffers(1, &id);
+  }
+  UniformBlock(const UniformBlock &) = delete;
+  UniformBlock &operator=(const UniformBlock &) = delete;
+  /**
+   *  Copies value into the next copy of the buffer and binds it, all draw
+   * calls since the last upload read the previous copy. Only waits if the GPU
+   * is still reading the copy from three uploads ago.
+   */
+  void upload(const T &value) {
+    if (fences[current])
+      glDeleteSync(fences[current]);
+    fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    current = (current + 1) % copies;
+    if (fences[current]) {
+      glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT,
+                       GLuint64(1e9));
+      glDeleteSync(fences[current]);
+      fences[current] = nullptr;
+    }
+    std::memcpy(mapped + current * stride, &value, sizeof(T));
+    glBindBufferRange(GL_UNIFORM_BUFFER, binding, id, current * stride, size);
   }
 };
 #endif
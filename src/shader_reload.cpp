@@ -0,0 +1,302 @@
+#include "shader_reload.hpp"
+#include "shader.hpp"
+#include <EGL/egl.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+// what the worker needs to preprocess a program, copied so that it never
+// touches the program itself
+struct Entry {
+  std::vector<std::pair<std::string, GLuint>> stages;
+  std::vector<std::string> defines, attribs;
+  // absolute paths of the stages and of all files of the program
+  std::set<std::string> roots, files;
+};
+struct Rebuild {
+  ShaderProgram *program = nullptr;
+  std::vector<std::pair<std::string, GLenum>> sources;
+  std::vector<std::string> files;
+  // program already linked by the worker, 0 if poll has to build it
+  GLuint linked = 0;
+  uint64_t key = 0;
+};
+// changes are collected until nothing happened for this long, editors write
+// a file in several steps
+static const int settle_ms = 50;
+static std::mutex mutex;
+// guarded by mutex
+static std::unordered_map<ShaderProgram *, Entry> watched;
+static std::vector<Rebuild> ready;
+static std::unordered_map<int, std::string> directories;
+// only used on the thread of the GL context
+static std::vector<ShaderProgram *> building;
+static std::thread worker;
+static int inotify_fd = -1, stop_pipe[2] = {-1, -1};
+// context of the worker sharing the objects of the render context
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext worker_context = EGL_NO_CONTEXT;
+static std::string absolute(const std::string &path) {
+  return std::filesystem::absolute(path).lexically_normal().string();
+}
+static std::set<std::string> absolute(const std::vector<std::string> &paths) {
+  std::set<std::string> result;
+  for (const std::string &path : paths)
+    result.insert(absolute(path));
+  return result;
+}
+/**
+ *  Adds inotify watches for the directories of the files that are not watched
+ * yet, mutex has to be held. Watching the directories instead of the files
+ * catches editors that replace the file by renaming a new one over it.
+ */
+static void watch_directories(const std::set<std::string> &files) {
+  for (const std::string &file : files) {
+    const std::string dir = std::filesystem::path(file).parent_path().string();
+    const int wd = inotify_add_watch(inotify_fd, dir.c_str(),
+                                     IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd < 0)
+      std::cerr << "Could not watch " << dir << ": " << strerror(errno)
+                << std::endl;
+    else
+      directories[wd] = dir;
+  }
+}
+/**
+ *  Removes the queued rebuild of the program, mutex has to be held
+ */
+static void drop(ShaderProgram *program) {
+  std::erase_if(ready, [program](const Rebuild &queued) {
+    if (queued.program == program && queued.linked)
+      glDeleteProgram(queued.linked);
+    return queued.program == program;
+  });
+}
+/**
+ *  Preprocesses every watched program built from one of the changed files,
+ * links it if the worker has a context and queues it for poll
+ */
+static void preprocess(std::set<std::string> changed) {
+  // the stages including a changed file have to be rebuilt as well
+  for (const std::string &file : std::set<std::string>(changed))
+    for (const std::string &dependent : shader_source::dependents(file))
+      changed.insert(dependent);
+  std::vector<std::pair<ShaderProgram *, Entry>> affected;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (auto &program : watched)
+      if (std::any_of(changed.begin(), changed.end(),
+                      [&program](const std::string &file) {
+                        return program.second.roots.count(file);
+                      }))
+        affected.push_back(program);
+  }
+  for (auto &program : affected) {
+    Rebuild rebuild;
+    rebuild.program = program.first;
+    rebuild.sources = ShaderProgram::preprocess(
+        program.second.stages, program.second.defines, &rebuild.files);
+    if (worker_context != EGL_NO_CONTEXT) {
+      std::vector<GLuint> shaders;
+      rebuild.linked = ShaderProgram::startLink(
+          rebuild.sources, program.second.attribs, shaders);
+      rebuild.key = program_cache::key(rebuild.sources);
+      // the render context may only use the program once it is linked
+      glFinish();
+      for (GLuint shader : shaders) {
+        checkShader(shader);
+        glDeleteShader(shader);
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = watched.find(program.first);
+    if (entry == watched.end()) {
+      if (rebuild.linked)
+        glDeleteProgram(rebuild.linked);
+      continue;
+    }
+    // the includes may have changed
+    entry->second.files = absolute(rebuild.files);
+    watch_directories(entry->second.files);
+    drop(rebuild.program);
+    ready.push_back(std::move(rebuild));
+  }
+}
+/**
+ *  Creates the context of the worker, sharing the objects of the current
+ * one. Only possible if that is an EGL context (GTK on Wayland and mostly on
+ * X11, the headless tools), otherwise poll compiles the rebuilds.
+ */
+static void create_worker_context() {
+  display = eglGetCurrentDisplay();
+  const EGLContext current = eglGetCurrentContext();
+  EGLint client = 0, config_id = 0, num_configs = 0;
+  if (current == EGL_NO_CONTEXT ||
+      !eglQueryContext(display, current, EGL_CONTEXT_CLIENT_TYPE, &client) ||
+      client != EGL_OPENGL_API)
+    return;
+  // contexts created without a config report id 0
+  EGLConfig config = nullptr;
+  eglQueryContext(display, current, EGL_CONFIG_ID, &config_id);
+  const EGLint config_attribs[] = {EGL_CONFIG_ID, config_id, EGL_NONE};
+  if (config_id &&
+      !eglChooseConfig(display, config_attribs, &config, 1, &num_configs))
+    return;
+  GLint major = 0, minor = 0, profile = 0;
+  glGetIntegerv(GL_MAJOR_VERSION, &major);
+  glGetIntegerv(GL_MINOR_VERSION, &minor);
+  glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &profile);
+  const EGLint context_attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION,
+      major,
+      EGL_CONTEXT_MINOR_VERSION,
+      minor,
+      EGL_CONTEXT_OPENGL_PROFILE_MASK,
+      profile & GL_CONTEXT_COMPATIBILITY_PROFILE_BIT
+          ? EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT
+          : EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+      EGL_NONE};
+  worker_context =
+      eglCreateContext(display, config, current, context_attribs);
+}
+static void run() {
+  if (worker_context != EGL_NO_CONTEXT) {
+    eglBindAPI(EGL_OPENGL_API);
+    if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        worker_context)) {
+      std::cerr << "Could not make the shader worker context current, "
+                   "compiling on the render thread"
+                << std::endl;
+      eglDestroyContext(display, worker_context);
+      worker_context = EGL_NO_CONTEXT;
+    }
+  }
+  alignas(inotify_event) char buffer[4096];
+  std::set<std::string> changed;
+  for (;;) {
+    pollfd fds[2] = {{inotify_fd, POLLIN, 0}, {stop_pipe[0], POLLIN, 0}};
+    const int events = ::poll(fds, 2, changed.empty() ? -1 : settle_ms);
+    if (events < 0 && errno != EINTR)
+      break;
+    if (fds[1].revents)
+      break;
+    if (events == 0) {
+      preprocess(changed);
+      changed.clear();
+      continue;
+    }
+    if (!(fds[0].revents & POLLIN))
+      continue;
+    const ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+    std::lock_guard<std::mutex> lock(mutex);
+    for (ssize_t i = 0; i < length;) {
+      const inotify_event *event = (const inotify_event *)(buffer + i);
+      auto dir = directories.find(event->wd);
+      if (event->len && dir != directories.end())
+        changed.insert(dir->second + "/" + event->name);
+      i += sizeof(inotify_event) + event->len;
+    }
+  }
+  if (worker_context != EGL_NO_CONTEXT) {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, worker_context);
+    worker_context = EGL_NO_CONTEXT;
+  }
+}
+bool shader_reload::start() {
+  if (worker.joinable())
+    return true;
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd < 0 || pipe2(stop_pipe, O_CLOEXEC)) {
+    std::cerr << "Shader hot reload not available: " << strerror(errno)
+              << std::endl;
+    if (inotify_fd >= 0)
+      close(inotify_fd);
+    inotify_fd = -1;
+    return false;
+  }
+  create_worker_context();
+  // without a worker context the driver can still compile the rebuilds on
+  // its own threads
+  if (hasExtension("GL_KHR_parallel_shader_compile"))
+    glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+  else if (hasExtension("GL_ARB_parallel_shader_compile"))
+    glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+  worker = std::thread(run);
+  return true;
+}
+void shader_reload::watch(ShaderProgram *program) {
+  if (!worker.joinable())
+    return;
+  std::lock_guard<std::mutex> lock(mutex);
+  Entry &entry = watched[program];
+  entry.stages = program->getStages();
+  entry.defines = program->getDefines();
+  entry.attribs = program->getAttributes();
+  for (auto &stage : program->getStages())
+    entry.roots.insert(absolute(stage.first));
+  entry.files = absolute(program->getFiles());
+  watch_directories(entry.files);
+}
+void shader_reload::unwatch(ShaderProgram *program) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    watched.erase(program);
+    drop(program);
+  }
+  std::erase(building, program);
+}
+bool shader_reload::poll() {
+  std::vector<Rebuild> started;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    started.swap(ready);
+  }
+  for (Rebuild &rebuild : started) {
+    if (rebuild.linked)
+      rebuild.program->adoptRebuild(rebuild.linked, rebuild.key,
+                                    rebuild.files);
+    else
+      rebuild.program->rebuild(rebuild.sources, rebuild.files);
+    if (std::find(building.begin(), building.end(), rebuild.program) ==
+        building.end())
+      building.push_back(rebuild.program);
+  }
+  bool swapped = false;
+  std::erase_if(building, [&swapped](ShaderProgram *program) {
+    if (program->finishRebuild()) {
+      std::cerr << "Reloaded " << program->getStages().back().first
+                << std::endl;
+      swapped = true;
+    }
+    return !program->rebuilding();
+  });
+  return swapped;
+}
+void shader_reload::stop() {
+  if (!worker.joinable())
+    return;
+  const char wake = 0;
+  if (write(stop_pipe[1], &wake, 1) != 1)
+    std::cerr << "Could not stop the shader watcher" << std::endl;
+  worker.join();
+  close(inotify_fd);
+  close(stop_pipe[0]);
+  close(stop_pipe[1]);
+  inotify_fd = stop_pipe[0] = stop_pipe[1] = -1;
+  std::lock_guard<std::mutex> lock(mutex);
+  watched.clear();
+  for (Rebuild &rebuild : ready)
+    glDeleteProgram(rebuild.linked);
+  ready.clear();
+  directories.clear();
+  building.clear();
+}
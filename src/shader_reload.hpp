@@ -0,0 +1,42 @@
+#ifndef SHADER_RELOAD_HPP
+#define SHADER_RELOAD_HPP
+class ShaderProgram;
+/**
+ *  Hot reload of shader programs: a worker thread watches the directories of
+ * the files every watched program was built from (includes as well) with
+ * inotify and rebuilds the programs whose files changed on its own context,
+ * which shares the objects of the render context. poll swaps a program only
+ * once its rebuild linked, so the render loop never waits for the compiler
+ * and keeps the old program on errors.
+ *  Without an EGL render context to share with, poll issues the rebuilds and
+ * the driver compiles them on its own threads (GL_KHR_parallel_shader_compile)
+ * or, lacking that, on the render thread.
+ */
+namespace shader_reload {
+/**
+ *  Starts the watcher, has to be called on the thread of the GL context.
+ * Returns false if file watching is not supported.
+ */
+bool start();
+/**
+ *  Rebuilds the program whenever one of its files changes, no-op if the
+ * watcher is not running
+ */
+void watch(ShaderProgram *program);
+/**
+ *  Stops watching the program, called by its cleanUp before it is deleted
+ */
+void unwatch(ShaderProgram *program);
+/**
+ *  Starts the rebuilds of the changed programs and swaps in the finished
+ * ones, called once per frame on the thread of the GL context
+ *  @return true if a program was swapped, so its uniform handles have to be
+ * resolved again
+ */
+bool poll();
+/**
+ *  Stops the watcher and forgets all programs
+ */
+void stop();
+} // namespace shader_reload
+#endif
@@ -0,0 +1,162 @@
+#include "shader_source.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+namespace fs = std::filesystem;
+// a file split into lines, the includes by line index
+struct Parsed {
+  fs::file_time_type mtime;
+  uintmax_t size;
+  std::vector<std::string> lines;
+  std::unordered_map<size_t, std::string> includes;
+};
+static std::mutex mutex;
+// guarded by mutex
+static std::unordered_map<std::string, Parsed> parsed;
+// source string numbers, 0 is left to the compiler for the first line
+static std::unordered_map<std::string, int> ids;
+static std::vector<std::string> names = {""};
+// files are keyed on their absolute path, so that the changes reported by the
+// hot reload can be looked up
+static std::string normal(const std::string &path) {
+  return fs::absolute(path).lexically_normal().string();
+}
+static int id(const std::string &path) {
+  auto it = ids.find(path);
+  if (it != ids.end())
+    return it->second;
+  std::error_code error;
+  const fs::path name = fs::relative(path, error);
+  names.push_back(error || name.empty() ? path : name.string());
+  return ids[path] = names.size() - 1;
+}
+/**
+ *  The path of an #include "path" line, empty for other lines
+ */
+static std::string include_path(const std::string &line) {
+  size_t i = line.find_first_not_of(" \t");
+  if (i == std::string::npos || line.compare(i, 8, "#include") != 0)
+    return "";
+  i = line.find_first_not_of(" \t", i + 8);
+  if (i == std::string::npos || line[i] != '"')
+    return "";
+  const size_t end = line.find('"', i + 1);
+  if (end == std::string::npos)
+    return "";
+  return line.substr(i + 1, end - i - 1);
+}
+/**
+ *  The parsed file, read again only if it changed. Null if it can not be
+ * read.
+ */
+static const Parsed *parse(const std::string &path) {
+  std::error_code error;
+  const fs::file_time_type mtime = fs::last_write_time(path, error);
+  const uintmax_t size = error ? 0 : fs::file_size(path, error);
+  if (error) {
+    std::cerr << "Could not read shader source " << path << ": "
+              << error.message() << std::endl;
+    parsed.erase(path);
+    return nullptr;
+  }
+  auto cached = parsed.find(path);
+  if (cached != parsed.end() && cached->second.mtime == mtime &&
+      cached->second.size == size)
+    return &cached->second;
+  Parsed &file = parsed[path];
+  file = {mtime, size, {}, {}};
+  std::ifstream in(path);
+  for (std::string line; std::getline(in, line);) {
+    const std::string include = include_path(line);
+    if (!include.empty())
+      file.includes[file.lines.size()] = normal(include);
+    file.lines.push_back(line);
+  }
+  return &file;
+}
+static void emit(const std::string &path, const std::string &extra,
+                 std::vector<std::string> &stack, std::set<std::string> &done,
+                 std::string &out, std::vector<std::string> *files) {
+  const Parsed *file = parse(path);
+  if (!file)
+    return;
+  if (files)
+    files->push_back(path);
+  stack.push_back(path);
+  done.insert(path);
+  const std::string number = std::to_string(id(path));
+  for (size_t i = 0; i < file->lines.size(); i++) {
+    auto include = file->includes.find(i);
+    if (include == file->includes.end()) {
+      out += file->lines[i];
+      out += '\n';
+    } else if (std::find(stack.begin(), stack.end(), include->second) !=
+               stack.end()) {
+      std::cerr << "Include cycle in shader sources:";
+      for (const std::string &from : stack)
+        std::cerr << " " << from << " ->";
+      std::cerr << " " << include->second << std::endl;
+      out += '\n';
+    } else if (done.count(include->second)) {
+      out += '\n';
+    } else {
+      out += "#line 1 " + std::to_string(id(include->second)) + '\n';
+      emit(include->second, "", stack, done, out, files);
+      out += "#line " + std::to_string(i + 2) + ' ' + number + '\n';
+    }
+    if (i == 0 && stack.size() == 1) {
+      out += extra;
+      out += "#line 2 " + number + '\n';
+    }
+  }
+  stack.pop_back();
+}
+std::string shader_source::load(const std::string &path,
+                                const std::string &extra,
+                                std::vector<std::string> *files) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<std::string> stack;
+  std::set<std::string> done;
+  std::string out;
+  emit(normal(path), extra, stack, done, out, files);
+  return out;
+}
+std::vector<std::string> shader_source::dependents(const std::string &path) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::set<std::string> found;
+  std::vector<std::string> open = {normal(path)};
+  while (!open.empty()) {
+    const std::string file = open.back();
+    open.pop_back();
+    for (auto &includer : parsed)
+      for (auto &include : includer.second.includes)
+        if (include.second == file && found.insert(includer.first).second)
+          open.push_back(includer.first);
+  }
+  return std::vector<std::string>(found.begin(), found.end());
+}
+std::string shader_source::annotate(const std::string &log) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::istringstream in(log);
+  std::string out;
+  for (std::string line; std::getline(in, line);) {
+    size_t digits = 0;
+    while (digits < line.size() && std::isdigit((unsigned char)line[digits]))
+      digits++;
+    if (digits && digits < 10 && digits < line.size() &&
+        (line[digits] == ':' || line[digits] == '(')) {
+      const size_t number = std::stoul(line.substr(0, digits));
+      if (number > 0 && number < names.size())
+        out += names[number] + ": ";
+    }
+    out += line;
+    out += '\n';
+  }
+  return out;
+}
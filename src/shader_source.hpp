@@ -0,0 +1,36 @@
+#ifndef SHADER_SOURCE_HPP
+#define SHADER_SOURCE_HPP
+#include <string>
+#include <vector>
+/**
+ *  Preprocessor for the #include "file" lines of the shaders. Every file is
+ * parsed once and kept until its modification time or size changes, so the
+ * shared libraries (frame, density, lighting, ...) are read once for all
+ * programs and variants.
+ *  A file is included at most once per source (later includes are skipped)
+ * and include cycles are reported. #line markers keep the line numbers of the
+ * compiler right, every file gets its own source string number (see
+ * annotate).
+ */
+namespace shader_source {
+/**
+ *  Resolves the includes of the file recursively and inserts extra (like
+ * #define lines) after its first line, the #version
+ *  @param files if not null, the absolute path of every file read is appended
+ * to it
+ */
+std::string load(const std::string &path, const std::string &extra = "",
+                 std::vector<std::string> *files = nullptr);
+/**
+ *  The absolute paths of the files that include the file, directly or not,
+ * as far as the files loaded so far tell
+ */
+std::vector<std::string> dependents(const std::string &path);
+/**
+ *  Prefixes the lines of a compiler log that start with the source string
+ * number of a file (like "3:12(1): error" or "3(12) : error") with its path
+ * relative to the working directory
+ */
+std::string annotate(const std::string &log);
+} // namespace shader_source
+#endif
@@ -25,6 +25,7 @@
  */
 
 #include "simplex.hpp"
+#include "simplex_simd.hpp"
 
 #include <cstdint> // int32_t/uint8_t
 
@@ -88,6 +89,7 @@ static const uint8_t perm[256] = {
     84,  204, 176, 115, 121, 50,  45,  127, 4,   150, 254, 138, 236, 205, 93,
     222, 114, 67,  29,  24,  72,  243, 141, 128, 195, 78,  66,  215, 61,  156,
     180};
+const uint8_t *const simplex_simd::perm_table = perm;
 
 /**
  * Helper function to hash an integer using the above permutation table
@@ -522,3 +524,71 @@ float SimplexNoise::fractal(size_t octaves, float x, float y, float z) const {
 
   return (output / denom);
 }
+
+/**
+ * Picks the widest SIMD kernel the cpu supports, or nullptr if there is none.
+ */
+template <typename Kernel>
+static Kernel select_kernel(Kernel avx512, Kernel avx2, Kernel sse4) {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    return avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return avx2;
+  if (__builtin_cpu_supports("sse4.1"))
+    return sse4;
+  return nullptr;
+}
+
+/**
+ * Batched 1D Perlin simplex noise
+ *
+ * @param[in]  x   n float coordinates
+ * @param[out] out n noise values, out[i] = noise(x[i])
+ * @param[in]  n   number of points
+ */
+void SimplexNoise::noise1(const float *x, float *out, size_t n) {
+  static const auto kernel =
+      select_kernel(&simplex_simd::noise1_avx512, &simplex_simd::noise1_avx2,
+                    &simplex_simd::noise1_sse4);
+  size_t done = kernel ? kernel(x, out, n) : 0;
+  for (; done < n; done++)
+    out[done] = noise(x[done]);
+}
+
+/**
+ * Batched 2D Perlin simplex noise
+ *
+ * @param[in]  x   n x float coordinates
+ * @param[in]  y   n y float coordinates
+ * @param[out] out n noise values, out[i] = noise(x[i], y[i])
+ * @param[in]  n   number of points
+ */
+void SimplexNoise::noise2(const float *x, const float *y, float *out,
+                          size_t n) {
+  static const auto kernel =
+      select_kernel(&simplex_simd::noise2_avx512, &simplex_simd::noise2_avx2,
+                    &simplex_simd::noise2_sse4);
+  size_t done = kernel ? kernel(x, y, out, n) : 0;
+  for (; done < n; done++)
+    out[done] = noise(x[done], y[done]);
+}
+
+/**
+ * Batched 3D Perlin simplex noise
+ *
+ * @param[in]  x   n x float coordinates
+ * @param[in]  y   n y float coordinates
+ * @param[in]  z   n z float coordinates
+ * @param[out] out n noise values, out[i] = noise(x[i], y[i], z[i])
+ * @param[in]  n   number of points
+ */
+void SimplexNoise::noise3(const float *x, const float *y, const float *z,
+                          float *out, size_t n) {
+  static const auto kernel =
+      select_kernel(&simplex_simd::noise3_avx512, &simplex_simd::noise3_avx2,
+                    &simplex_simd::noise3_sse4);
+  size_t done = kernel ? kernel(x, y, z, out, n) : 0;
+  for (; done < n; done++)
+    out[done] = noise(x[done], y[done], z[done]);
+}
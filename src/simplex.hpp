@@ -24,6 +24,15 @@ public:
   // 3D Perlin simplex noise
   static float noise(float x, float y, float z);
 
+  // Batched 1D/2D/3D Perlin simplex noise over n points (out[i] = noise(x[i],
+  // ...)), using the widest SIMD kernel (AVX-512, AVX2 or SSE4.1) supported by
+  // the cpu. The results are bit identical to the scalar functions, see
+  // simplex_simd.hpp.
+  static void noise1(const float *x, float *out, size_t n);
+  static void noise2(const float *x, const float *y, float *out, size_t n);
+  static void noise3(const float *x, const float *y, const float *z,
+                     float *out, size_t n);
+
   // Fractal/Fractional Brownian Motion (fBm) noise summation
   float fractal(size_t octaves, float x) const;
   float fractal(size_t octaves, float x, float y) const;
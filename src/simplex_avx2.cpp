@@ -0,0 +1,12 @@
+#include "simplex_simd.hpp"
+size_t simplex_simd::noise1_avx2(const float *x, float *out, size_t n) {
+  return noise1<8>(x, out, n);
+}
+size_t simplex_simd::noise2_avx2(const float *x, const float *y, float *out,
+                                 size_t n) {
+  return noise2<8>(x, y, out, n);
+}
+size_t simplex_simd::noise3_avx2(const float *x, const float *y,
+                                 const float *z, float *out, size_t n) {
+  return noise3<8>(x, y, z, out, n);
+}
@@ -0,0 +1,208 @@
+/**
+ * @file    simplex_simd.hpp
+ * @brief   Vectorized kernels for the batched SimplexNoise functions.
+ *
+ * The kernels are written once with GCC vector extensions and instantiated in
+ * one translation unit per instruction set (simplex_sse4.cpp,
+ * simplex_avx2.cpp, simplex_avx512.cpp), which are compiled with the
+ * corresponding -m flags. SimplexNoise::noise1/2/3 picks the widest one the cpu
+ * supports at runtime.
+ *
+ * Every kernel performs the same float operations in the same order as the
+ * scalar SimplexNoise::noise functions, so as long as no FMA contraction takes
+ * place (the kernels are compiled with -ffp-contract=off) the results are bit
+ * identical to the scalar path. Should a compiler contract anyway the results
+ * differ by at most 1e-6.
+ */
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace simplex_simd {
+// the permutation table of simplex.cpp
+extern const uint8_t *const perm_table;
+
+// Each kernel evaluates the largest multiple of its vector width of the n
+// points and returns how many points it has processed.
+size_t noise1_sse4(const float *x, float *out, size_t n);
+size_t noise2_sse4(const float *x, const float *y, float *out, size_t n);
+size_t noise3_sse4(const float *x, const float *y, const float *z, float *out,
+                   size_t n);
+size_t noise1_avx2(const float *x, float *out, size_t n);
+size_t noise2_avx2(const float *x, const float *y, float *out, size_t n);
+size_t noise3_avx2(const float *x, const float *y, const float *z, float *out,
+                   size_t n);
+size_t noise1_avx512(const float *x, float *out, size_t n);
+size_t noise2_avx512(const float *x, const float *y, float *out, size_t n);
+size_t noise3_avx512(const float *x, const float *y, const float *z,
+                     float *out, size_t n);
+
+// The templates get internal linkage, since each instruction set translation
+// unit compiles them with different target flags and the linker must never
+// merge those instantiations.
+namespace {
+template <int W> struct vec {
+  typedef float F __attribute__((vector_size(W * sizeof(float))));
+  typedef int32_t I __attribute__((vector_size(W * sizeof(int32_t))));
+};
+template <int W> using vf = typename vec<W>::F;
+template <int W> using vi = typename vec<W>::I;
+
+template <int W> inline vf<W> load(const float *p) {
+  vf<W> v;
+  __builtin_memcpy(&v, p, sizeof(v));
+  return v;
+}
+template <int W> inline void store(float *p, vf<W> v) {
+  __builtin_memcpy(p, &v, sizeof(v));
+}
+template <int W> inline vf<W> to_float(vi<W> i) {
+  return __builtin_convertvector(i, vf<W>);
+}
+// same as fastfloor in simplex.cpp
+template <int W> inline vi<W> fastfloor(vf<W> fp) {
+  vi<W> i = __builtin_convertvector(fp, vi<W>);
+  // comparisons are -1 where true
+  return i + (vi<W>)(fp < to_float<W>(i));
+}
+// there is no gather instruction for bytes, so it is done lane by lane
+template <int W> inline vi<W> hash(vi<W> i) {
+  vi<W> r;
+  for (int l = 0; l < W; l++)
+    r[l] = perm_table[static_cast<uint8_t>(i[l])];
+  return r;
+}
+template <int W> inline vf<W> grad(vi<W> hash, vf<W> x) {
+  const vi<W> h = hash & 0x0F;
+  vf<W> grad = 1.0f + to_float<W>(h & 7);
+  grad = (h & 8) != 0 ? -grad : grad;
+  return grad * x;
+}
+template <int W> inline vf<W> grad(vi<W> hash, vf<W> x, vf<W> y) {
+  const vi<W> h = hash & 0x3F;
+  const vf<W> u = h < 4 ? x : y;
+  const vf<W> v = h < 4 ? y : x;
+  return ((h & 1) != 0 ? -u : u) + ((h & 2) != 0 ? -2.0f * v : 2.0f * v);
+}
+template <int W> inline vf<W> grad(vi<W> hash, vf<W> x, vf<W> y, vf<W> z) {
+  const vi<W> h = hash & 15;
+  const vf<W> u = h < 8 ? x : y;
+  const vf<W> v = h < 4 ? y : (h == 12 || h == 14) ? x : z;
+  return ((h & 1) != 0 ? -u : u) + ((h & 2) != 0 ? -v : v);
+}
+// t^4 * g where t >= 0, else 0
+template <int W> inline vf<W> contribution(vf<W> t, vf<W> g) {
+  const vf<W> t2 = t * t;
+  const vf<W> zero = {};
+  return t < 0.0f ? zero : t2 * t2 * g;
+}
+
+template <int W> size_t noise1(const float *px, float *out, size_t n) {
+  size_t done = 0;
+  for (; done + W <= n; done += W) {
+    const vf<W> x = load<W>(px + done);
+    const vi<W> i0 = fastfloor<W>(x);
+    const vi<W> i1 = i0 + 1;
+    const vf<W> x0 = x - to_float<W>(i0);
+    const vf<W> x1 = x0 - 1.0f;
+    vf<W> t0 = 1.0f - x0 * x0;
+    t0 *= t0;
+    const vf<W> n0 = t0 * t0 * grad<W>(hash<W>(i0), x0);
+    vf<W> t1 = 1.0f - x1 * x1;
+    t1 *= t1;
+    const vf<W> n1 = t1 * t1 * grad<W>(hash<W>(i1), x1);
+    store<W>(out + done, 0.395f * (n0 + n1));
+  }
+  return done;
+}
+
+template <int W>
+size_t noise2(const float *px, const float *py, float *out, size_t n) {
+  static const float F2 = 0.366025403f;
+  static const float G2 = 0.211324865f;
+  size_t done = 0;
+  for (; done + W <= n; done += W) {
+    const vf<W> x = load<W>(px + done);
+    const vf<W> y = load<W>(py + done);
+    const vf<W> s = (x + y) * F2;
+    const vi<W> i = fastfloor<W>(x + s);
+    const vi<W> j = fastfloor<W>(y + s);
+    const vf<W> t = to_float<W>(i + j) * G2;
+    const vf<W> x0 = x - (to_float<W>(i) - t);
+    const vf<W> y0 = y - (to_float<W>(j) - t);
+    // lower (1, 0) or upper (0, 1) triangle
+    const vi<W> i1 = (vi<W>)(x0 > y0) & 1;
+    const vi<W> j1 = 1 - i1;
+    const vf<W> x1 = x0 - to_float<W>(i1) + G2;
+    const vf<W> y1 = y0 - to_float<W>(j1) + G2;
+    const vf<W> x2 = x0 - 1.0f + 2.0f * G2;
+    const vf<W> y2 = y0 - 1.0f + 2.0f * G2;
+    const vi<W> gi0 = hash<W>(i + hash<W>(j));
+    const vi<W> gi1 = hash<W>(i + i1 + hash<W>(j + j1));
+    const vi<W> gi2 = hash<W>(i + 1 + hash<W>(j + 1));
+    const vf<W> n0 =
+        contribution<W>(0.5f - x0 * x0 - y0 * y0, grad<W>(gi0, x0, y0));
+    const vf<W> n1 =
+        contribution<W>(0.5f - x1 * x1 - y1 * y1, grad<W>(gi1, x1, y1));
+    const vf<W> n2 =
+        contribution<W>(0.5f - x2 * x2 - y2 * y2, grad<W>(gi2, x2, y2));
+    store<W>(out + done, 45.23065f * (n0 + n1 + n2));
+  }
+  return done;
+}
+
+template <int W>
+size_t noise3(const float *px, const float *py, const float *pz, float *out,
+              size_t n) {
+  static const float F3 = 1.0f / 3.0f;
+  static const float G3 = 1.0f / 6.0f;
+  size_t done = 0;
+  for (; done + W <= n; done += W) {
+    const vf<W> x = load<W>(px + done);
+    const vf<W> y = load<W>(py + done);
+    const vf<W> z = load<W>(pz + done);
+    const vf<W> s = (x + y + z) * F3;
+    const vi<W> i = fastfloor<W>(x + s);
+    const vi<W> j = fastfloor<W>(y + s);
+    const vi<W> k = fastfloor<W>(z + s);
+    const vf<W> t = to_float<W>(i + j + k) * G3;
+    const vf<W> x0 = x - (to_float<W>(i) - t);
+    const vf<W> y0 = y - (to_float<W>(j) - t);
+    const vf<W> z0 = z - (to_float<W>(k) - t);
+    // branchless version of the rank ordering in SimplexNoise::noise
+    const vi<W> xy = (vi<W>)(x0 >= y0);
+    const vi<W> yz = (vi<W>)(y0 >= z0);
+    const vi<W> xz = (vi<W>)(x0 >= z0);
+    const vi<W> i1 = xy & (yz | xz) & 1;
+    const vi<W> j1 = ~xy & yz & 1;
+    const vi<W> k1 = ~yz & (~xy | ~xz) & 1;
+    const vi<W> i2 = (xy | (yz & xz)) & 1;
+    const vi<W> j2 = (~xy | yz) & 1;
+    const vi<W> k2 = ~(yz & xz) & 1;
+    const vf<W> x1 = x0 - to_float<W>(i1) + G3;
+    const vf<W> y1 = y0 - to_float<W>(j1) + G3;
+    const vf<W> z1 = z0 - to_float<W>(k1) + G3;
+    const vf<W> x2 = x0 - to_float<W>(i2) + 2.0f * G3;
+    const vf<W> y2 = y0 - to_float<W>(j2) + 2.0f * G3;
+    const vf<W> z2 = z0 - to_float<W>(k2) + 2.0f * G3;
+    const vf<W> x3 = x0 - 1.0f + 3.0f * G3;
+    const vf<W> y3 = y0 - 1.0f + 3.0f * G3;
+    const vf<W> z3 = z0 - 1.0f + 3.0f * G3;
+    const vi<W> gi0 = hash<W>(i + hash<W>(j + hash<W>(k)));
+    const vi<W> gi1 = hash<W>(i + i1 + hash<W>(j + j1 + hash<W>(k + k1)));
+    const vi<W> gi2 = hash<W>(i + i2 + hash<W>(j + j2 + hash<W>(k + k2)));
+    const vi<W> gi3 = hash<W>(i + 1 + hash<W>(j + 1 + hash<W>(k + 1)));
+    const vf<W> n0 = contribution<W>(0.6f - x0 * x0 - y0 * y0 - z0 * z0,
+                                     grad<W>(gi0, x0, y0, z0));
+    const vf<W> n1 = contribution<W>(0.6f - x1 * x1 - y1 * y1 - z1 * z1,
+                                     grad<W>(gi1, x1, y1, z1));
+    const vf<W> n2 = contribution<W>(0.6f - x2 * x2 - y2 * y2 - z2 * z2,
+                                     grad<W>(gi2, x2, y2, z2));
+    const vf<W> n3 = contribution<W>(0.6f - x3 * x3 - y3 * y3 - z3 * z3,
+                                     grad<W>(gi3, x3, y3, z3));
+    store<W>(out + done, 32.0f * (n0 + n1 + n2 + n3));
+  }
+  return done;
+}
+} // namespace
+} // namespace simplex_simd
@@ -0,0 +1,12 @@
+#include "simplex_simd.hpp"
+size_t simplex_simd::noise1_sse4(const float *x, float *out, size_t n) {
+  return noise1<4>(x, out, n);
+}
+size_t simplex_simd::noise2_sse4(const float *x, const float *y, float *out,
+                                 size_t n) {
+  return noise2<4>(x, y, out, n);
+}
+size_t simplex_simd::noise3_sse4(const float *x, const float *y,
+                                 const float *z, float *out, size_t n) {
+  return noise3<4>(x, y, z, out, n);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef TARGET_POOL_HPP
+#define TARGET_POOL_HPP
+#include "framebuffer.hpp"
+#include <algorithm>
+#include <initializer_list>
+#include <vector>
+/**
+ *  Transient render targets shared by the passes of a frame. A pass acquires
+ * a target by size and formats and releases it once no later pass reads it,
+ * then later passes and frames get the same target (resized within its
+ * storage) instead of allocating their own. Targets idle for max_idle frames
+ * are deleted, so targets of settings that changed do not linger.
+ */
+class TargetPool {
+  struct Entry {
+    Framebuffer *target;
+    std::vector<GLint> formats;
+    GLenum depth;
+    bool used = false;
+    unsigned int last_frame = 0;
+  };
+  static const unsigned int max_idle = 8;
+  std::vector<Entry> entries;
+  unsigned int frame = 0;
+
+public:
+  TargetPool() {}
+  ~TargetPool() {
+    for (Entry &entry : entries)
+      delete entry.target;
+  }
+  TargetPool(const TargetPool &) = delete;
+  TargetPool &operator=(const TargetPool &) = delete;
+  /**
+   *  Returns a target that no other pass holds, with one color texture per
+   * format (in this order) and a depth buffer if depth is not 0. Targets of
+   * the same size are preferred.
+   */
+  Framebuffer *acquire(glm::ivec2 size, std::initializer_list<GLint> formats,
+                       GLenum depth = 0) {
+    Entry *found = nullptr;
+    for (Entry &entry : entries)
+      if (!entry.used && entry.depth == depth &&
+          std::equal(formats.begin(), formats.end(), entry.formats.begin(),
+                     entry.formats.end()) &&
+          (!found || entry.target->getSize() == size))
+        found = &entry;
+    if (!found) {
+      entries.push_back({new Framebuffer(size.x, size.y), formats, depth});
+      found = &entries.back();
+      for (GLint format : formats)
+        found->target->generateColorTexture(format);
+      if (depth)
+        found->target->generateDepthBuffer(depth);
+    } else if (found->target->getSize() != size)
+      found->target->resize(size.x, size.y);
+    found->used = true;
+    found->last_frame = frame;
+    return found->target;
+  }
+  /**
+   *  Hands the target back to the pool, its contents may be overwritten by
+   * the next acquire
+   */
+  void release(Framebuffer *target) {
+    for (Entry &entry : entries)
+      if (entry.target == target)
+        entry.used = false;
+  }
+  /**
+   *  Releases all targets at the end of the frame and deletes the idle ones
+   */
+  void endFrame() {
+    frame++;
+    std::erase_if(entries, [this](Entry &entry) {
+      entry.used = false;
+      if (frame - entry.last_frame <= max_idle)
+        return false;
+      delete entry.target;
+      return true;
+    });
+  }
+};
+#endif
@@ -6,7 +6,7 @@ Texture::~Texture() {
   if (data)
     stbi_image_free(data);
   if (loadedToGPU)
-    glDeleteTextures(1, &openglimg);
+    gl_state::delete_texture(openglimg);
 }
 
 struct MemoryWrapper {
@@ -50,15 +50,15 @@ void freeTexture(std::string path) {
 }
 void Texture::resizeTexture(GLuint tex, unsigned int width, unsigned int height,
                             GLuint type, GLuint datatype, GLuint format) {
-  glBindTexture(GL_TEXTURE_2D, tex);
+  gl_state::bind_texture(GL_TEXTURE_2D, tex);
   glTexImage2D(GL_TEXTURE_2D, 0, type, width, height, 0, format, datatype, 0);
-  glBindTexture(GL_TEXTURE_2D, 0);
+  gl_state::bind_texture(GL_TEXTURE_2D, 0);
 }
 void Texture::loadToGPU(GLint wrap, GLint minFilter, GLint magFilter) {
   if (!loadedToGPU) {
 
     glGenTextures(1, &openglimg);
-    glBindTexture(GL_TEXTURE_2D, openglimg);
+    gl_state::bind_texture(GL_TEXTURE_2D, openglimg);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
@@ -103,7 +103,7 @@ GLuint Texture::loadBinary(unsigned char *data, int width, int height,
                            GLint magFilter) {
   GLuint foo;
   glGenTextures(1, &foo);
-  glBindTexture(GL_TEXTURE_2D, foo);
+  gl_state::bind_texture(GL_TEXTURE_2D, foo);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
@@ -126,7 +126,7 @@ GLuint Texture::loadBinary(float *data, int width, int height, int channels,
                            GLint wrap, GLint minFilter, GLint magFilter) {
   GLuint foo;
   glGenTextures(1, &foo);
-  glBindTexture(GL_TEXTURE_2D, foo);
+  gl_state::bind_texture(GL_TEXTURE_2D, foo);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
@@ -149,9 +149,10 @@ GLuint Texture::loadBinary3D(unsigned char *data, int width, int height,
                              GLint minFilter, GLint magFilter) {
   GLuint foo;
   glGenTextures(1, &foo);
-  glBindTexture(GL_TEXTURE_3D, foo);
+  gl_state::bind_texture(GL_TEXTURE_3D, foo);
   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, wrap);
   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, wrap);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, wrap);
   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, magFilter);
   glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, minFilter);
   glTexImage3D(GL_TEXTURE_3D, 0,
@@ -173,8 +174,12 @@ GLuint Texture::loadBinary3D(float *data, int width, int height, int depth,
                              GLint magFilter) {
   GLuint foo;
   glGenTextures(1, &foo);
-  glBindTexture(GL_TEXTURE_3D, foo);
-
+  gl_state::bind_texture(GL_TEXTURE_3D, foo);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, wrap);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, wrap);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, wrap);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, magFilter);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, minFilter);
   glTexImage3D(GL_TEXTURE_3D, 0,
                channels == 4   ? GL_RGBA32F
                : channels == 3 ? GL_RGB32F
@@ -190,7 +195,7 @@ GLuint Texture::loadBinary3D(float *data, int width, int height, int depth,
 }
 
 void Texture::enableTextureMipMapping(GLuint tex) {
-  glBindTexture(GL_TEXTURE_2D, tex);
+  gl_state::bind_texture(GL_TEXTURE_2D, tex);
   glGenerateMipmap(GL_TEXTURE_2D);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
                   GL_LINEAR_MIPMAP_LINEAR);
@@ -1,6 +1,7 @@
 #pragma once
 #ifndef TEXTURE_HPP
 #define TEXTURE_HPP
+#include "gl_state.hpp"
 #include <GL/glew.h>
 #include <string>
 #include <unordered_map>
@@ -59,9 +60,9 @@ struct Texture {
   void loadToGPU(GLint wrap = GL_REPEAT, GLint minFilter = GL_LINEAR,
                  GLint magFilter = GL_LINEAR);
 
-  void bind() { glBindTexture(GL_TEXTURE_2D, openglimg); }
+  void bind() { gl_state::bind_texture(GL_TEXTURE_2D, openglimg); }
 
-  void unbind() { glBindTexture(GL_TEXTURE_2D, 0); }
+  void unbind() { gl_state::bind_texture(GL_TEXTURE_2D, 0); }
   void enableMipMapping();
 };
 /**
@@ -1,11 +1,27 @@
 #ifndef VAO_HPP
 #define VAO_HPP
+#include "gl_state.hpp"
 #include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <iostream>
 #include <optional>
+#include <span>
 #include <string>
 #include <type_traits>
 #include <vector>
+/**
+ *  Points the attribute at the data of the bound GL_ARRAY_BUFFER starting at
+ * the byte offset
+ */
+template <typename T>
+static void setAttribPointer(unsigned int index, unsigned int stride,
+                             GLintptr offset = 0) {
+  if (std::is_same<T, float>() || std::is_same<T, const float>())
+    glVertexAttribPointer(index, stride, GL_FLOAT, GL_FALSE, 0,
+                          (const void *)offset);
+  else
+    glVertexAttribIPointer(index, stride, GL_INT, 0, (const void *)offset);
+}
 template <typename T>
 static unsigned int genVBO(unsigned int index, unsigned int stride, T *data,
                            unsigned int len) {
@@ -19,12 +35,9 @@ static unsigned int genVBO(unsigned int index, unsigned int stride, T *data,
   unsigned int id;
   glGenBuffers(1, &id);
   glBindBuffer(GL_ARRAY_BUFFER, id);
-  glBufferData(GL_ARRAY_BUFFER, len * sizeof(float), data, GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, len * sizeof(T), data, GL_STATIC_DRAW);
   glEnableVertexAttribArray(index);
-  if (std::is_same<T, float>() || std::is_same<T, const float>())
-    glVertexAttribPointer(index, stride, GL_FLOAT, GL_FALSE, 0, nullptr);
-  else
-    glVertexAttribIPointer(index, stride, GL_INT, 0, nullptr);
+  setAttribPointer<T>(index, stride);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
 #ifdef DEBUG_BCE
   global::gpu_time += glfwGetTime() - start;
@@ -44,10 +57,7 @@ static unsigned int genInstancedVBO(unsigned int index, unsigned int stride,
   glBindBuffer(GL_ARRAY_BUFFER, id);
   glBufferData(GL_ARRAY_BUFFER, len * sizeof(T), data, GL_DYNAMIC_DRAW);
   glEnableVertexAttribArray(index);
-  if (std::is_same<T, float>() || std::is_same<T, const float>())
-    glVertexAttribPointer(index, stride, GL_FLOAT, GL_FALSE, 0, nullptr);
-  else
-    glVertexAttribIPointer(index, stride, GL_INT, 0, nullptr);
+  setAttribPointer<T>(index, stride);
   glVertexAttribDivisor(index, divisor);
   glBindBuffer(GL_ARRAY_BUFFER, 0);
   return id;
@@ -57,6 +67,12 @@ struct Vbo {
   unsigned int index;
   bool instanced = false;
   GLuint dim;
+  // streamed vbos: the persistent mapping, split into regions of region bytes
+  // (one per frame in flight) and the fences of the draws that read them
+  char *mapped = nullptr;
+  GLsizeiptr region = 0;
+  std::vector<GLsync> fences;
+  unsigned int current = 0;
   Vbo(const GLuint id, unsigned int index, GLuint dim, bool instanced = false)
       : id(id), index(index), dim(dim), instanced(instanced) {}
 };
@@ -71,7 +87,7 @@ public:
   Vao() { glGenVertexArrays(1, &id); };
   void addIndexBuffer(const unsigned int *data, size_t count) {
     itemsCount = count;
-    glBindVertexArray(id);
+    gl_state::bind_vertex_array(id);
     GLuint indid;
     glGenBuffers(1, &indid);
     indicesId = std::optional<GLuint>(indid);
@@ -100,7 +116,7 @@ public:
   template <typename T>
   unsigned int addVertexBuffer(unsigned int dim, const T *data,
                                unsigned int len) {
-    glBindVertexArray(id);
+    gl_state::bind_vertex_array(id);
     vbos.emplace_back(genVBO(vbos.size(), dim, data, len), vbos.size(), dim);
     if (!indicesId.has_value())
       itemsCount = len / dim;
@@ -135,7 +151,7 @@ public:
   template <typename T>
   unsigned int addInstancedVertexBuffer(unsigned int dim, const T *data,
                                         unsigned int len, int div = 1) {
-    glBindVertexArray(id);
+    gl_state::bind_vertex_array(id);
     vbos.emplace_back(genInstancedVBO(vbos.size(), dim, data, len, div),
                       vbos.size(), dim, true);
     if (!instanceCount.has_value())
@@ -160,6 +176,90 @@ public:
                                         int div = 1) {
     return addInstancedVertexBuffer(dim, data.data(), data.size(), div);
   }
+  /**
+   * Adds a streamed vertex buffer to the Vao, for data written anew every
+   * frame (like the instances of many volumes or particles). The buffer has
+   * immutable storage that stays mapped, split into one region of capacity
+   * entries per frame in flight. streamVBO hands out the next region for
+   * writing, so there is no copy by the driver and no implicit sync.
+   * Only int and float datatypes are supported, updateVBO must not be used
+   * on it.
+   * @param dim      Dimension or stride of the vbo (e.g. 3 for a vec3)
+   * @param capacity maximum count of entries written per frame
+   * @param div      Attribute Divisor Count, 0 for per vertex data
+   * @param frames   count of regions, so the GPU may read the data of
+   * frames - 1 earlier frames while the next one is written
+   * @return the index of this vbo
+   */
+  template <typename T>
+  unsigned int addStreamingVertexBuffer(unsigned int dim, unsigned int capacity,
+                                        int div = 0, unsigned int frames = 3) {
+    static_assert(std::is_same<T, float>() || std::is_same<T, int>(),
+                  "Only float and int data is permitted in vbos!");
+    const GLsizeiptr region = sizeof(T) * capacity;
+    const GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    gl_state::bind_vertex_array(id);
+    GLuint vbo;
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferStorage(GL_ARRAY_BUFFER, region * frames, nullptr, flags);
+    char *mapped =
+        (char *)glMapBufferRange(GL_ARRAY_BUFFER, 0, region * frames, flags);
+    glEnableVertexAttribArray(vbos.size());
+    setAttribPointer<T>(vbos.size(), dim);
+    if (div)
+      glVertexAttribDivisor(vbos.size(), div);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    Vbo &stream = vbos.emplace_back(vbo, vbos.size(), dim, div != 0);
+    stream.mapped = mapped;
+    stream.region = region;
+    stream.fences.assign(frames, nullptr);
+    stream.current = frames - 1;
+    if (div && !instanceCount.has_value())
+      instanceCount = 1;
+    return vbos.size() - 1;
+  }
+  /**
+   * Returns the next region of a streamed vbo for writing len entries and
+   * points the attribute at it. The draws since the last call read the
+   * previous region, so it is called once per frame before the draws. Only
+   * waits if the GPU still reads the region written frames calls ago.
+   * @param index the index of this vbo in the vao
+   * @param len   the count of entries that will be written, at most the
+   * capacity of the vbo
+   */
+  template <typename T> std::span<T> streamVBO(int index, unsigned int len) {
+    static_assert(std::is_same<T, float>() || std::is_same<T, int>(),
+                  "Only float and int data is permitted in vbos!");
+    Vbo &stream = vbos[index];
+    if (len * sizeof(T) > size_t(stream.region)) {
+      std::cerr << "Streamed vbo " << index << " holds "
+                << stream.region / sizeof(T) << " entries, not " << len
+                << std::endl;
+      len = stream.region / sizeof(T);
+    }
+    // all draws reading the current region have been issued by now
+    if (stream.fences[stream.current])
+      glDeleteSync(stream.fences[stream.current]);
+    stream.fences[stream.current] =
+        glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    stream.current = (stream.current + 1) % stream.fences.size();
+    GLsync &fence = stream.fences[stream.current];
+    if (fence) {
+      glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1e9));
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+    gl_state::bind_vertex_array(this->id);
+    glBindBuffer(GL_ARRAY_BUFFER, stream.id);
+    setAttribPointer<T>(stream.index, stream.dim,
+                        stream.current * stream.region);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (!stream.instanced && !indicesId.has_value())
+      itemsCount = len / stream.dim;
+    return {(T *)(stream.mapped + stream.current * stream.region), len};
+  }
   /**
    * Updates the data of an instanced vbo
    * @param index the index of this vbo in the vao
@@ -171,7 +271,7 @@ public:
   void updateVBO(int index, const T *data, size_t start, unsigned int len) {
     static_assert(std::is_same<T, float>() || std::is_same<T, int>(),
                   "Only float and int data is permitted in vbos!");
-    glBindVertexArray(this->id);
+    gl_state::bind_vertex_array(this->id);
     glBindBuffer(GL_ARRAY_BUFFER, vbos[index].id);
     glBufferSubData(GL_ARRAY_BUFFER, start, sizeof(T) * len, &data[0]);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -187,7 +287,7 @@ public:
   void updateVBO(int index, const T *data, unsigned int len) {
     static_assert(std::is_same<T, float>() || std::is_same<T, int>(),
                   "Only float and int data is permitted in vbos!");
-    glBindVertexArray(this->id);
+    gl_state::bind_vertex_array(this->id);
     glBindBuffer(GL_ARRAY_BUFFER, vbos[index].id);
     glBufferData(GL_ARRAY_BUFFER, sizeof(T) * len, &(data[0]), GL_DYNAMIC_DRAW);
     if (!indicesId.has_value())
@@ -219,17 +319,22 @@ public:
    * Cleans up all OpenGL related data.
    */
   void cleanUp() {
-    for (Vbo v : vbos)
+    for (Vbo v : vbos) {
+      for (GLsync fence : v.fences)
+        if (fence)
+          glDeleteSync(fence);
+      // deleting the buffer unmaps it
       glDeleteBuffers(1, &v.id);
+    }
     if (indicesId.has_value())
       glDeleteBuffers(1, &indicesId.value());
-    glDeleteVertexArrays(1, &id);
+    gl_state::delete_vertex_array(id);
   }
-  void bind() { glBindVertexArray(id); }
+  void bind() { gl_state::bind_vertex_array(id); }
   /**
    * Not actually necessary
    */
-  void unbind() { glBindVertexArray(0); }
+  void unbind() { gl_state::bind_vertex_array(0); }
   /**
    * Draws the vao data corresponding to the present vbos
    */
@@ -1,3 +1,4 @@
+#include "gl_state.hpp"
 #include "gtkmm/enums.h"
 #include "gtkmm/glarea.h"
 #include "gtkmm/scrolledwindow.h"
@@ -5,6 +6,21 @@
 #include "sigc++/functors/mem_fun.h"
 #include "sigc++/functors/ptr_fun.h"
 #include <gtkmm.h>
+// GTK binds its framebuffer and sets the viewport before every frame, both
+// only change with the size, and it binds textures of its own
+static bool gl_resized = true;
+static bool signal_render(const Glib::RefPtr<Gdk::GLContext> &context) {
+  if (gl_resized)
+    gl_state::invalidate();
+  else
+    gl_state::forget_textures();
+  gl_resized = false;
+  return cloud_renderer::render();
+}
+static void signal_resize(int width, int height) {
+  gl_resized = true;
+  cloud_renderer::resize(width, height);
+}
 static bool signal_x_rotation(Gtk::ScrollType, double newval) {
   cloud_renderer::set_view_angle_x(newval);
   return true;
@@ -32,9 +48,13 @@ class CloudWindow : public Gtk::Window {
   }
   // render settings
   Gtk::Scale x_rotation, y_rotation, radius, step_size;
+  Gtk::CheckButton adaptive_steps, ray_jitter, backface_prepass, compute_backend;
+  Gtk::ComboBoxText resolution_divisor, temporal_subset, shadow_steps,
+      frontside_format;
   Gtk::ScrolledWindow render_settings;
   Gtk::Box render_settings_content, x_rotation_box, y_rotation_box, radius_box,
-      step_size_box;
+      step_size_box, resolution_divisor_box, temporal_subset_box,
+      shadow_steps_box, frontside_format_box;
   void construct_render_settings() {
     render_settings.set_child(render_settings_content);
     Gtk::Scale *scales[4] = {&x_rotation, &y_rotation, &radius, &step_size};
@@ -68,6 +88,108 @@ class CloudWindow : public Gtk::Window {
 
     step_size.signal_change_value().connect(sigc::ptr_fun(&signal_step_size),
                                             true);
+    adaptive_steps.set_label("adaptive step size");
+    adaptive_steps.set_margin_start(15);
+    adaptive_steps.signal_toggled().connect(
+        sigc::mem_fun(*this, &CloudWindow::on_adaptive_steps_toggled));
+    render_settings_content.append(adaptive_steps);
+    ray_jitter.set_label("jitter ray start");
+    ray_jitter.set_margin_start(15);
+    ray_jitter.signal_toggled().connect(
+        sigc::mem_fun(*this, &CloudWindow::on_ray_jitter_toggled));
+    render_settings_content.append(ray_jitter);
+    backface_prepass.set_label("back-face prepass");
+    backface_prepass.set_margin_start(15);
+    backface_prepass.signal_toggled().connect(
+        sigc::mem_fun(*this, &CloudWindow::on_backface_prepass_toggled));
+    render_settings_content.append(backface_prepass);
+    compute_backend.set_label("compute shader");
+    compute_backend.set_margin_start(15);
+    compute_backend.signal_toggled().connect(
+        sigc::mem_fun(*this, &CloudWindow::on_compute_backend_toggled));
+    render_settings_content.append(compute_backend);
+    // ids are the divisors passed to the renderer
+    resolution_divisor.append("1", "full");
+    resolution_divisor.append("2", "half");
+    resolution_divisor.append("4", "quarter");
+    resolution_divisor.set_active_id("1");
+    resolution_divisor.set_hexpand();
+    resolution_divisor.signal_changed().connect(
+        sigc::mem_fun(*this, &CloudWindow::on_resolution_divisor_changed));
+    Gtk::Label label("ray marching resolution: ");
+    resolution_divisor_box.append(label);
+    resolution_divisor_box.set_margin_start(15);
+    resolution_divisor_box.append(resolution_divisor);
+    render_settings_content.append(resolution_divisor_box);
+    // ids are the number of frames a pixel is marched in
+    temporal_subset.append("1", "every frame");
+    temporal_subset.append("4", "every 4th frame");
+    temporal_subset.append("16", "every 16th frame");
+    temporal_subset.set_active_id("1");
+    temporal_subset.set_hexpand();
+    temporal_subset.signal_changed().connect(
+        sigc::mem_fun(*this, &CloudWindow::on_temporal_subset_changed));
+    Gtk::Label subset_label("march each pixel: ");
+    temporal_subset_box.append(subset_label);
+    temporal_subset_box.set_margin_start(15);
+    temporal_subset_box.append(temporal_subset);
+    render_settings_content.append(temporal_subset_box);
+    // ids are the samples per shadow ray
+    shadow_steps.append("5", "5");
+    shadow_steps.append("10", "10");
+    shadow_steps.append("20", "20");
+    shadow_steps.set_active_id("10");
+    shadow_steps.set_hexpand();
+    shadow_steps.signal_changed().connect(
+        sigc::mem_fun(*this, &CloudWindow::on_shadow_steps_changed));
+    Gtk::Label shadow_label("shadow ray samples: ");
+    shadow_steps_box.append(shadow_label);
+    shadow_steps_box.set_margin_start(15);
+    shadow_steps_box.append(shadow_steps);
+    render_settings_content.append(shadow_steps_box);
+    // ids are the internal formats of the front face target
+    frontside_format.append(std::to_string(GL_RGBA32F), "positions (RGBA32F)");
+    frontside_format.append(std::to_string(GL_RGBA16F), "box coords (RGBA16F)");
+    frontside_format.append(std::to_string(GL_RGB10_A2),
+                            "box coords (RGB10_A2)");
+    frontside_format.append(std::to_string(GL_R32F), "ray depth (R32F)");
+    frontside_format.append(std::to_string(GL_R16F), "ray depth (R16F)");
+    frontside_format.set_active_id(std::to_string(GL_RGBA32F));
+    frontside_format.set_hexpand();
+    frontside_format.signal_changed().connect(
+        sigc::mem_fun(*this, &CloudWindow::on_frontside_format_changed));
+    Gtk::Label frontside_label("front faces: ");
+    frontside_format_box.append(frontside_label);
+    frontside_format_box.set_margin_start(15);
+    frontside_format_box.append(frontside_format);
+    render_settings_content.append(frontside_format_box);
+  }
+  void on_adaptive_steps_toggled() {
+    cloud_renderer::set_adaptive_steps(adaptive_steps.get_active());
+  }
+  void on_ray_jitter_toggled() {
+    cloud_renderer::set_ray_jitter(ray_jitter.get_active());
+  }
+  void on_backface_prepass_toggled() {
+    cloud_renderer::set_single_pass(!backface_prepass.get_active());
+  }
+  void on_compute_backend_toggled() {
+    cloud_renderer::set_compute_backend(compute_backend.get_active());
+  }
+  void on_resolution_divisor_changed() {
+    cloud_renderer::set_resolution_divisor(
+        std::stoi(resolution_divisor.get_active_id()));
+  }
+  void on_temporal_subset_changed() {
+    cloud_renderer::set_temporal_subset(
+        std::stoi(temporal_subset.get_active_id()));
+  }
+  void on_shadow_steps_changed() {
+    cloud_renderer::set_shadow_steps(std::stoi(shadow_steps.get_active_id()));
+  }
+  void on_frontside_format_changed() {
+    cloud_renderer::set_frontside_format(
+        std::stoi(frontside_format.get_active_id()));
   }
 
 public:
@@ -80,7 +202,11 @@ public:
         render_settings_content(Gtk::Orientation::VERTICAL),
         x_rotation_box(Gtk::Orientation::HORIZONTAL),
         y_rotation_box(Gtk::Orientation::HORIZONTAL),
-        step_size_box(Gtk::Orientation::HORIZONTAL) {
+        step_size_box(Gtk::Orientation::HORIZONTAL),
+        resolution_divisor_box(Gtk::Orientation::HORIZONTAL),
+        temporal_subset_box(Gtk::Orientation::HORIZONTAL),
+        shadow_steps_box(Gtk::Orientation::HORIZONTAL),
+        frontside_format_box(Gtk::Orientation::HORIZONTAL) {
     set_title("Cloud simulation");
     maximize();
     set_child(divider);
@@ -92,10 +218,9 @@ public:
     settings_notebook.set_size_request(300, -1);
     settings_notebook.set_show_border(false);
     cloud_window.set_has_depth_buffer(true);
-    cloud_window.signal_render().connect(sigc::ptr_fun(&cloud_renderer::render),
-                                         true);
-    cloud_window.signal_resize().connect(sigc::ptr_fun(&cloud_renderer::resize),
+    cloud_window.signal_render().connect(sigc::ptr_fun(&signal_render),
                                          true);
+    cloud_window.signal_resize().connect(sigc::ptr_fun(&signal_resize), true);
     cloud_window.set_auto_render();
     cloud_window.add_tick_callback(sigc::mem_fun(*this, &CloudWindow::on_tick));
     divider.set_margin(0);
@@ -103,6 +228,8 @@ public:
     divider.set_end_child(settings_notebook);
     divider.set_start_child(cloud_window);
     construct_render_settings();
+    // shaders are tuned while the window is open
+    cloud_renderer::set_hot_reload(true);
   }
   ~CloudWindow() { cloud_renderer::cleanup(); }
 };